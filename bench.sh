@@ -0,0 +1,60 @@
+#!/bin/sh
+# 6518738 zy18738 Hangjian Yuan
+#
+# Generates maps from a fixed seed with mazegen.c and times each solver of dungeon.c on them.
+# The "open" maps have no walls and one exit in the bottom right corner, they are written here.
+# The results are written to stdout as CSV, one line per map and solver.
+# "bfs" is the plain BFS of "getShortestPath", so it's the baseline of the other solvers.
+#
+# Usage: ./bench.sh [max cells] [seed]
+# The maps have 10^3, 10^4, ... cells up to "max cells", which is 10^7 by default.
+# 10^9 cells needs about 2 GB of disk for each map, and much more memory for "bfs".
+
+set -e
+
+MAX_CELLS=${1:-10000000}
+SEED=${2:-1}
+SOLVERS="bfs bidirectional astar jps parallel dobfs hpa"
+TYPES="maze cave rooms serpentine open"
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/dungeon-bench.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+
+cc -O2 -pthread -o "$WORK/dungeon" dungeon.c
+cc -O2 -o "$WORK/mazegen" mazegen.c
+
+# writes an open map of "$1" x "$2" to "$3", whose only exit is the bottom right corner.
+writeOpenMap() {
+    {
+        echo "$1 $2"
+        row=$(head -c "$1" < /dev/zero | tr '\0' '.')
+        yes "$row" | head -n $(($2 - 1))
+        head -c $(($1 - 1)) < /dev/zero | tr '\0' '.'
+        echo x
+    } > "$3"
+}
+
+echo "type,cells,algorithm,width,height,load_ms,solve_ms,peak_rss_kb,expanded,expanded_per_second"
+
+cells=1000
+while [ "$cells" -le "$MAX_CELLS" ]; do
+    side=$(awk "BEGIN { printf \"%d\", sqrt($cells) + 0.5 }")
+
+    for type in $TYPES; do
+        if [ "$type" = "open" ]; then
+            writeOpenMap "$side" "$side" "$WORK/$type.map"
+        else
+            "$WORK/mazegen" "$type" "$side" "$side" "$SEED" "$WORK/$type.map"
+        fi
+
+        # the path goes to /dev/null, only the benchmark line on stderr is kept.
+        for solver in $SOLVERS; do
+            "$WORK/dungeon" --algo="$solver" --bench "$WORK/$type.map" 0 0 2>&1 >/dev/null |
+                sed "s/^/$type,$cells,/"
+        done
+
+        rm -f "$WORK/$type.map"
+    done
+
+    cells=$((cells * 10))
+done
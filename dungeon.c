@@ -4,519 +4,8001 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
-// this structure is used to store points.
-struct point {
-    unsigned int x;
-    unsigned int y;
-    struct point *parentPtr;
-    struct point *nextPtr;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef DUNGEON_STATS
+#include <malloc.h>
+#endif
+
+// the size of the first read when the file is read as a stream.
+#define STREAM_CHUNK_SIZE 65536
+
+// the size of the buffer which the paths are printed through.
+#define OUTPUT_BUFFER_SIZE 65536
+
+// the longest text added to the output buffer at once, two numbers and separators.
+#define OUTPUT_ITEM_SIZE 48
+
+// the number of queries which can wait for a worker of the daemon.
+#define DAEMON_QUEUE_SIZE 64
+
+// the most queries of one client of the daemon socket waiting for their answers.
+// The next lines of the client are read when some of them have been answered.
+#define DAEMON_CLIENT_PENDING 64
+
+// the initial size of the list of clients of the daemon socket.
+#define DAEMON_CLIENT_LIST_SIZE 16
+
+// the longest query line read by the daemon.
+#define QUERY_LINE_SIZE 256
+
+// the suffix of the cache file saved next to the map.
+#define CACHE_SUFFIX ".dcache"
+
+// the first bytes of a cache file, the last digit is the version.
+#define CACHE_MAGIC "DCACHE1"
+
+// the suffix of the component labels saved next to the map, and their first bytes.
+#define COMPONENT_SUFFIX ".dcomp"
+#define COMPONENT_MAGIC "DCOMPS1"
+
+// the largest number of threads which can be used by "--threads".
+#define MAX_THREADS 256
+
+// the parallel BFS expands a level on one thread unless its frontier has
+// at least this many cells for each thread, since a level costs four barriers.
+#define PARALLEL_LEVEL_SIZE 256
+
+// the direction-optimizing BFS follows Beamer's rule: it sweeps bottom-up when the edges out of the frontier
+// are more than the unvisited open cells divided by the first value, and switches back to top-down
+// when they are fewer than the unvisited open cells divided by the second.
+#define BOTTOM_UP_ALPHA 14
+#define BOTTOM_UP_BETA 24
+
+// the largest move cost of a terrain glyph in the legend.
+#define MAX_TERRAIN_COST 255
+
+// the initial size of the list of exits.
+#define EXIT_LIST_SIZE 16
+
+// the most cells a map can have to be searched with 32-bit cell IDs.
+// A cell past the last one is used as a sentinel, so one ID is kept free.
+#define MAX_CELL_COUNT ((uint64_t)INT_MAX - 1)
+
+// the suffix of the HPA* index file saved next to the map, and its first bytes.
+#define HPA_SUFFIX ".dhpa"
+#define HPA_MAGIC "DHPA1"
+
+// the default side of an HPA* cluster, and the largest side.
+#define CLUSTER_SIZE 32
+#define MAX_CLUSTER_SIZE 1024
+
+// an entrance between two clusters with this many cells or more gets a node at each end.
+#define ENTRANCE_SPLIT 6
+
+// the first bytes of a binary map file, the last digit is the version.
+#define BINARY_MAGIC "DMAP1"
+
+// the first bytes of a tiled map file, the last digit is the version.
+#define TILED_MAGIC "DTILE1"
+
+// the default side of a tile in a tiled map, and the largest side.
+#define TILE_SIZE 1024
+#define MAX_TILE_SIZE 32768
+
+// the default number of tiles kept in memory by the out-of-core solver.
+#define TILE_CACHE_SIZE 64
+
+// the number of frontier records kept in memory before they are spilled to disk.
+#define FRONTIER_BUFFER_SIZE (1 << 20)
+
+// the blocked layout of "--layout=blocked" stores 8 x 8 cells together, one cache line of bytes.
+#define BLOCK_SHIFT 3
+#define BLOCK_SIDE (1 << BLOCK_SHIFT)
+#define BLOCK_CELLS (BLOCK_SIDE * BLOCK_SIDE)
+
+// the values of a cell in the blocked layout, the parent direction is saved above them.
+enum blockedCell { BLOCKED_WALL, BLOCKED_OPEN, BLOCKED_EXIT, BLOCKED_VISITED = 4 };
+
+// the values of a cell in a tiled map, 2 bits each.
+enum tiledCell { TILED_WALL, TILED_OPEN, TILED_EXIT };
+
+// the state of a cell in the out-of-core solver, 4 bits each.
+// The lowest 2 bits are the direction of the parent.
+enum tiledState { STATE_ROOT = 4, STATE_VISITED = 8 };
+
+// the initial size of each bucket in a bucket queue.
+#define BUCKET_SIZE 16
+
+// the four directions, in the same order as "getNeighbours".
+enum direction { UP, DOWN, LEFT, RIGHT };
+
+// the values saved in a direction field, "UP" to "RIGHT" are the next move towards the exit.
+enum fieldValue { FIELD_EXIT = 4, FIELD_NONE = 5 };
+
+// the phases timed by "--stats".
+enum phase { PHASE_PARSE, PHASE_VALIDATE, PHASE_SOLVE, PHASE_PATH, PHASE_OUTPUT, PHASE_COUNT };
+
+// the expanded cells are counted in every build, since "--bench" reports them too.
+// Each search counts them in a local variable and adds them once at the end (or once per level),
+// so the loops don't write to memory for it, and only one thread adds at a time.
+#define COUNT_EXPANDED(value) (expandedCells += (value))
+
+// the counters of "--stats" only exist when the program is built with "-DDUNGEON_STATS".
+// Otherwise these macros are empty, so the solvers are not slowed down.
+#ifdef DUNGEON_STATS
+#define STAT_ADD(counter, value) atomic_fetch_add_explicit(&stats.counter, (value), memory_order_relaxed)
+#define STAT_MAX(counter, value) updateStatMax(&stats.counter, (value))
+#define STAT_PHASE(phase) markStatPhase(phase)
+#define malloc(size) statMalloc(size)
+#define calloc(count, size) statCalloc(count, size)
+#define realloc(ptr, size) statRealloc(ptr, size)
+#else
+#define STAT_ADD(counter, value) ((void)0)
+#define STAT_MAX(counter, value) ((void)0)
+#define STAT_PHASE(phase) ((void)0)
+#endif
+
+// the solvers which can be selected with "--algo".
+enum algorithm { ALGO_BFS, ALGO_BIDIRECTIONAL, ALGO_ASTAR, ALGO_JPS, ALGO_PARALLEL, ALGO_DOBFS, ALGO_HPA };
+
+// the layouts of the grid which can be selected with "--layout".
+enum layout { LAYOUT_ROWS, LAYOUT_BLOCKED };
+
+// this structure is used to store the maze.
+// The rows are kept in place, so the cell (x, y) is "cells[y * stride + x]".
+struct maze {
+    char *data;
+    size_t dataSize;
+    bool mapped;
+    bool regular;
+    const char *cells;
+    size_t stride;
+    int width;
+    int height;
+    uint64_t cellCount;
+    int64_t *exits;
+    int exitCount;
+    int exitLimit;
+    int exitMinX;
+    int exitMaxX;
+    int exitMinY;
+    int exitMaxY;
+    unsigned char costs[256];
+    bool hasLegend;
+    bool weighted;
+    int maxCost;
+};
+typedef struct maze Maze;
+
+// this structure is used to store the command line options.
+struct options {
+    const char *path;
+    int x;
+    int y;
+    int algorithm;
+    int layout;
+    bool queryMode;
+    const char *queryPath;
+    bool dynamicMode;
+    bool bench;
+    bool stats;
+    bool compact;
+    bool components;
+    bool daemonMode;
+    const char *daemonPath;
+    const char *dynamicPath;
+    bool useCache;
+    int threads;
+    bool convertTiled;
+    bool convertBinary;
+    const char *outputPath;
+    int tileSize;
+    int tileCacheSize;
+    int clusterSize;
+};
+typedef struct options Options;
+
+// this structure is a direction field built by a BFS from the exit.
+// Each cell uses 4 bits, so two cells are packed into one byte.
+// When the field is read from a cache file, "mapping" is the mapped file.
+struct field {
+    unsigned char *directions;
+    int width;
+    int height;
+    void *mapping;
+    size_t mappingSize;
+};
+typedef struct field Field;
+
+// this structure stores the connected components of the open cells.
+// "labels" is the component of each cell, or -1 for a wall, and "exits" tells which components have an exit.
+// When it's read from a cache file, "mapping" is the mapped file.
+struct components {
+    int32_t *labels;
+    unsigned char *exits;
+    int count;
+    void *mapping;
+    size_t mappingSize;
+};
+typedef struct components Components;
+
+// this structure is the band of rows labelled by one thread.
+struct componentBand {
+    const Maze *maze;
+    int32_t *labels;
+    int firstRow;
+    int lastRow;
+};
+typedef struct componentBand ComponentBand;
+
+// this structure is shared by the threads of the parallel BFS.
+// The frontier of each level is split between the threads,
+// and the cells of the next level are collected by each thread first.
+struct worker;
+struct parallelSearch {
+    const Maze *maze;
+    int *distance;
+    atomic_uint_fast64_t *visited;
+    int *frontier;
+    int frontierSize;
+    int *next;
+    int level;
+    atomic_int exitCell;
+    atomic_bool found;
+    atomic_bool failed;
+    bool finished;
+    struct worker *workers;
+    int threadCount;
+    bool ready;
+    pthread_mutex_t lock;
+    pthread_cond_t readyCond;
+    pthread_barrier_t barrier;
+};
+typedef struct parallelSearch ParallelSearch;
+
+// this structure is the work of one thread in the parallel BFS.
+struct worker {
+    ParallelSearch *search;
+    int id;
+    int *cells;
+    int size;
+    int limit;
+    int offset;
+};
+typedef struct worker Worker;
+
+// this structure is a frontier of the direction-optimizing BFS kept as a bitset, one bit per cell.
+// Each row starts at a new word, the words "first[row]" to "last[row]" are the only ones which can be set,
+// and "minRow" to "maxRow" are the only rows which can have cells.
+struct bitFrontier {
+    uint64_t *bits;
+    int *first;
+    int *last;
+    int minRow;
+    int maxRow;
+};
+typedef struct bitFrontier BitFrontier;
+
+// this structure is one word of the grid of the direction-optimizing BFS, with one bit for each of its 64 cells.
+// "low" and "high" are the two bits of the level tag of each reached cell,
+// the four words of the same cells are kept together so a cell only touches one cache line.
+struct gridWord {
+    uint64_t unvisited;
+    uint64_t exits;
+    uint64_t low;
+    uint64_t high;
+};
+typedef struct gridWord GridWord;
+
+// this structure is the header of a binary map file.
+// The exits follow it as (x, y) pairs, then the legend as (glyph, cost) pairs,
+// then each row as runs of a glyph and a varint length.
+struct binaryHeader {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t exitCount;
+    uint32_t legendCount;
+};
+typedef struct binaryHeader BinaryHeader;
+
+// this structure is the header of a tiled map file.
+// The tiles follow it row by row, and each cell of a tile uses 2 bits.
+// The cells out of the map are walls.
+struct tiledHeader {
+    char magic[8];
+    uint64_t width;
+    uint64_t height;
+    uint64_t tilesX;
+    uint64_t tilesY;
+    uint32_t tileSize;
+    uint32_t reserved;
+};
+typedef struct tiledHeader TiledHeader;
+
+// this structure is a tile kept in memory by the out-of-core solver.
+// "state" is written back to the state file when the tile is evicted.
+struct tile {
+    uint64_t id;
+    unsigned char *cells;
+    unsigned char *state;
+    bool dirty;
+    uint64_t lastUsed;
+};
+typedef struct tile Tile;
+
+// this structure keeps at most "capacity" tiles in memory, the least recently used one is evicted.
+struct tileCache {
+    int mapFd;
+    FILE *stateFile;
+    TiledHeader header;
+    size_t cellBytes;
+    size_t stateBytes;
+    Tile *tiles;
+    int capacity;
+    uint64_t clock;
+};
+typedef struct tileCache TileCache;
+
+// this structure is a cell waiting in the frontier of the out-of-core solver.
+struct frontierRecord {
+    uint64_t tile;
+    uint32_t cell;
+    uint32_t parent;
 };
-typedef struct point Point;
+typedef struct frontierRecord FrontierRecord;
 
-// this structure is used to keep track of the shortest path.
-// It's only used to print the shortest path.
-struct record {
-    Point *pointPtr;
-    struct record *prevPtr;
+// this structure is one level of the out-of-core solver.
+// The records are sorted by tile, in the spill files and in the buffer.
+struct frontier {
+    FILE **runs;
+    int runCount;
+    int runLimit;
+    FrontierRecord *buffer;
+    size_t size;
 };
-typedef struct record Record;
+typedef struct frontier Frontier;
+
+// this structure reads the records of a level in order, merging the spill files and the buffer.
+struct frontierReader {
+    Frontier *frontier;
+    FrontierRecord *heads;
+    bool *alive;
+    size_t bufferIndex;
+};
+typedef struct frontierReader FrontierReader;
+
+// this structure is everything used by the out-of-core solver,
+// so it can be freed in one place when error occurs.
+struct tiledSearch {
+    TileCache cache;
+    Frontier current;
+    Frontier next;
+    FrontierReader reader;
+    FILE *pathFile;
+};
+typedef struct tiledSearch TiledSearch;
+
+// this structure is the header of a cache file, the direction field follows it.
+struct cacheHeader {
+    char magic[8];
+    uint64_t hash;
+    int32_t width;
+    int32_t height;
+    uint64_t size;
+};
+typedef struct cacheHeader CacheHeader;
+
+// this structure is the header of an HPA* index file.
+// The arrays of the index follow it in the same order as in "HpaIndex".
+struct hpaHeader {
+    char magic[8];
+    uint64_t hash;
+    int32_t width;
+    int32_t height;
+    int32_t clusterSize;
+    int32_t nodeCount;
+    int32_t edgeCount;
+    int32_t maxEdgeCost;
+};
+typedef struct hpaHeader HpaHeader;
+
+// this structure is an edge of the abstract graph, "cost" is the distance to "target".
+struct hpaEdge {
+    int32_t target;
+    int32_t cost;
+};
+typedef struct hpaEdge HpaEdge;
+
+// this structure is the hierarchical index used by HPA*.
+// The map is split into square clusters, the nodes are the entrances between clusters and the exits.
+// The nodes of a cluster are "nodes[firstNode[cluster]]" to "nodes[firstNode[cluster + 1] - 1]", sorted by cell.
+// The edges of a node are "edges[firstEdge[node]]" to "edges[firstEdge[node + 1] - 1]".
+// When the index is read from an index file, "mapping" is the mapped file.
+struct hpaIndex {
+    int clusterSize;
+    int clustersX;
+    int clustersY;
+    int nodeCount;
+    int edgeCount;
+    int maxEdgeCost;
+    int32_t *nodes;
+    int32_t *firstNode;
+    int32_t *firstEdge;
+    HpaEdge *edges;
+    void *mapping;
+    size_t mappingSize;
+};
+typedef struct hpaIndex HpaIndex;
+
+// this structure is one bucket of a bucket queue.
+struct bucket {
+    int *cells;
+    int size;
+    int limit;
+};
+typedef struct bucket Bucket;
+
+// this structure is a priority queue for small integer keys.
+// All the keys in the queue are less than "current + count",
+// so the buckets are reused as a ring.
+struct bucketQueue {
+    Bucket *buckets;
+    int count;
+    int current;
+    int size;
+};
+typedef struct bucketQueue BucketQueue;
+
+// this structure holds the buffers of the bidirectional BFS, so they are reused by each search.
+// Side 0 searches from the start, side 1 searches from the exits.
+// A cell is "y * stride + x" here, so the '\n' at the end of each row stops the moves left and right.
+// "visited" keeps the words of both sides for the same 64 cells next to each other, side 0 first.
+// "queue" lists the cells reached by each side, and "parents" the index of the parent of each one in the queue,
+// so only the cells reached by the last search are reset.
+struct bidirectionalSearch {
+    uint64_t *visited;
+    int *queue[2];
+    int *parents[2];
+    int tail[2];
+};
+typedef struct bidirectionalSearch BidirectionalSearch;
+
+// this structure holds the buffers of a search inside one cluster.
+struct hpaLocal {
+    int clusterSize;
+    int *distance;
+    int *parent;
+    int *path;
+    BucketQueue queue;
+};
+typedef struct hpaLocal HpaLocal;
+
+// this structure holds the buffers of HPA* queries, so they are reused by each query.
+// "touched" lists the nodes reached by the last query.
+struct hpaSearch {
+    const HpaIndex *index;
+    int *distance;
+    int *parent;
+    int *touched;
+    int touchedCount;
+    int *route;
+    BucketQueue queue;
+    HpaLocal local;
+};
+typedef struct hpaSearch HpaSearch;
+
+// this structure is the distance field of a map whose walls change.
+// "field" is the next move of each cell, and "repair" lists the cells being repaired.
+struct dynamicField {
+    Field field;
+    int *distance;
+    int *repair;
+    int repairLimit;
+    uint64_t *seeds;
+    int seedCount;
+    int seedLimit;
+    BucketQueue queue;
+};
+typedef struct dynamicField DynamicField;
+
+// this structure is a copy of the maze in the blocked layout, used by the BFS.
+// A cell is "(row << BLOCK_SHIFT) | column" inside its block, and the blocks are stored row by row.
+// The maze is moved one cell right and down, so it's surrounded by walls and a move never leaves the grid.
+struct blockedGrid {
+    unsigned char *cells;
+    int blocksX;
+    int blocksY;
+    int rowSize;
+    int moves[4][BLOCK_CELLS];
+};
+typedef struct blockedGrid BlockedGrid;
+
+// this structure is used to print the paths through one buffer.
+// In compact mode only the first cell is printed, and the moves follow as runs, e.g. "R12 D3 L5".
+// Without "output" the whole text is kept, and the buffer grows when it's full.
+struct pathWriter {
+    char *buffer;
+    size_t size;
+    size_t limit;
+    FILE *output;
+    bool failed;
+    bool compact;
+    uint64_t count;
+    uint64_t lastX;
+    uint64_t lastY;
+    char move;
+    uint64_t run;
+    uint64_t runCount;
+};
+typedef struct pathWriter PathWriter;
+
+// this structure is a map kept in memory by the daemon, with its direction field.
+struct daemonMap {
+    const char *name;
+    size_t nameLength;
+    Maze maze;
+    Field field;
+};
+typedef struct daemonMap DaemonMap;
+
+// this structure is a client of the daemon socket.
+// The main thread reads its queries and sends its answers, the workers only add the answers to "output".
+// The queries are numbered by "nextQuery", and "nextAnswer" is the number of the next answer to add,
+// so the answers are sent in the order of the queries.
+struct daemonClient {
+    int fd;
+    char input[QUERY_LINE_SIZE];
+    size_t inputSize;
+    bool overlong;
+    bool closing;
+    bool failed;
+    uint64_t nextQuery;
+    uint64_t nextAnswer;
+    int pending;
+    char *output;
+    size_t outputSize;
+    size_t outputLimit;
+    size_t outputSent;
+};
+typedef struct daemonClient DaemonClient;
+
+// this structure is a query line waiting for a worker of the daemon.
+// "client" is NULL for the lines from stdin, which are numbered so the answers are printed in the same order.
+struct daemonJob {
+    DaemonClient *client;
+    uint64_t sequence;
+    char line[QUERY_LINE_SIZE];
+};
+typedef struct daemonJob DaemonJob;
+
+// this structure is shared by all the threads of the daemon.
+// The maps and the fields are only read after they are loaded.
+// The list of clients is only used by the main thread, which is woken up through "wakeFds".
+struct daemon {
+    DaemonMap *maps;
+    int mapCount;
+    bool compact;
+    DaemonClient **clients;
+    int clientCount;
+    int clientLimit;
+    int wakeFds[2];
+    DaemonJob jobs[DAEMON_QUEUE_SIZE];
+    int jobHead;
+    int jobCount;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t jobCond;
+    pthread_cond_t spaceCond;
+    uint64_t nextSequence;
+    pthread_cond_t turnCond;
+};
+typedef struct daemon Daemon;
+
+// this structure is the scratch space of one worker of the daemon.
+// It's reused by every query, so the answers don't allocate memory once it has grown.
+struct daemonWorker {
+    Daemon *daemon;
+    PathWriter writer;
+};
+typedef struct daemonWorker DaemonWorker;
+
+#ifdef DUNGEON_STATS
+// this structure is used to store the counters and the phase times of "--stats".
+// The counters are shared by all the threads of the parallel BFS.
+struct stats {
+    atomic_ullong enqueued;
+    atomic_ullong maxFrontier;
+    atomic_ullong bytes;
+    atomic_ullong pathLength;
+    atomic_ullong bottomUpLevels;
+    double phaseTimes[PHASE_COUNT];
+    int phase;
+    double phaseStart;
+};
+typedef struct stats Stats;
+
+Stats stats;
+#endif
+
+uint64_t expandedCells = 0;
+
+// "SIGINT" and "SIGTERM" stop the daemon, the signal handler writes to "daemonWakeFd" to wake it up.
+volatile sig_atomic_t daemonStopped = 0;
+int daemonWakeFd = -1;
 
 // function prototypes
 void errorHandle(const int errorCode);
 int readCoordinate(const char *string);
-void readOneChar(FILE *fPtr, char *dest, char *buffer);
-void getMazeSize(FILE *fPtr, int *width, int *height);
-char *getMaze(FILE *fPtr, const int width, const int height);
-Point *appendPoint(Point *tailPtr);
-void freeAllPoints(Point *startPtr);
-void getShortestPath(char *mazePtr, const int width, const int height, const int x, const int y);
-void freeAllRecords(Record *topPtr);
-bool printShortestPath(Point *exitPtr);
+void readOptions(const int argc, char const *argv[], Options *options);
+int readOptionNumber(const char *string, const int min, const int max);
+char *readStream(const int fd, size_t *size);
+void loadMazeFile(const char *path, Maze *maze);
+void freeMaze(Maze *maze);
+int readNumber(const Maze *maze, size_t *offset);
+size_t getMazeSize(Maze *maze);
+size_t getLegend(Maze *maze, size_t offset);
+int scanRow(const char *row, const int width);
+int scanRowWithLegend(const Maze *maze, const char *row, bool *weighted);
+bool appendExit(Maze *maze, const int x, const int y);
+bool writeVarint(FILE *fPtr, uint32_t value);
+bool readVarint(const Maze *maze, size_t *offset, uint32_t *value);
+void convertBinary(const Options *options);
+bool isBinaryMaze(const Maze *maze);
+void decodeBinaryMaze(Maze *maze);
+void getMaze(const char *path, Maze *maze);
+bool fitsCellIds(const Options *options, const Maze *maze);
+bool checkStartingLocation(Maze *maze, const int x, const int y);
+int getNeighbours(const Maze *maze, const int cell, int *neighbours);
+bool isExit(const Maze *maze, const int cell);
+int getCost(const Maze *maze, const int cell);
+void getShortestPath(Maze *maze, const int x, const int y, PathWriter *writer);
+void getShortestPathBidirectional(Maze *maze, const int x, const int y, PathWriter *writer);
+bool initBidirectionalSearch(BidirectionalSearch *search, const Maze *maze);
+void freeBidirectionalSearch(BidirectionalSearch *search);
+bool searchBidirectional(const Maze *maze, BidirectionalSearch *search, const int start, PathWriter *writer);
+int findQueuedCell(const int *queue, const int first, const int last, const int cell);
+bool initBucketQueue(BucketQueue *queue, const int count);
+void freeBucketQueue(BucketQueue *queue);
+bool pushBucketQueue(BucketQueue *queue, const int key, const int cell);
+int popBucketQueue(BucketQueue *queue, int *key);
+int getHeuristic(const Maze *maze, const int cell);
+void getShortestPathAStar(Maze *maze, const int x, const int y, PathWriter *writer);
+bool isOpen(const Maze *maze, const int x, const int y);
+bool isForced(const Maze *maze, const int x, const int y, const int dir);
+int jumpHorizontal(const Maze *maze, int x, int y, const int dir);
+int jump(const Maze *maze, int x, int y, const int dir);
+void getShortestPathJPS(Maze *maze, const int x, const int y, PathWriter *writer);
+int getFieldDirection(const Field *field, const int cell);
+void setFieldDirection(Field *field, const int cell, const int direction);
+bool buildField(const Maze *maze, Field *field);
+void freeField(Field *field);
+bool readQuery(const char *line, int *x, int *y);
+void printFieldPath(const Maze *maze, const Field *field, const int x, const int y, PathWriter *writer);
+bool answerQueries(Maze *maze, const Field *field, HpaSearch *search, FILE *input, PathWriter *writer);
+uint64_t hashMaze(const Maze *maze);
+char *getCachePath(const char *path, const char *suffix);
+bool loadFieldCache(const char *cachePath, const Maze *maze, const uint64_t hash, Field *field);
+void saveFieldCache(const char *cachePath, const Field *field, const uint64_t hash);
+bool getField(const Maze *maze, const Options *options, Field *field);
+bool appendWorkerCell(Worker *worker, const int cell);
+void *expandLevels(void *arg);
+void expandSmallLevels(ParallelSearch *search);
+void getShortestPathParallel(Maze *maze, const int x, const int y, const int threadCount, PathWriter *writer);
+void buildGridWords(const Maze *maze, GridWord *grid, const int wordsPerRow);
+int sweepBottomUp(const Maze *maze, GridWord *grid, const int wordsPerRow, BitFrontier *frontier, BitFrontier *next,
+                  const int level, int *exitCell);
+void clearBitFrontierRow(BitFrontier *frontier, const int row, const int wordsPerRow);
+int listBitFrontier(BitFrontier *frontier, const int width, const int wordsPerRow, int *cells);
+int getLevelTag(const int level);
+void setLevelTags(GridWord *word, const uint64_t cells, const int tag);
+int getCellTag(const GridWord *grid, const int wordsPerRow, const int row, const int col);
+void descendTaggedPath(const Maze *maze, const GridWord *grid, int cell, const int distance, int *path);
+void freeDirectionSearch(GridWord *grid, int *frontier, int *next, BitFrontier *bits);
+void getShortestPathDirectionOptimizing(Maze *maze, const int x, const int y, PathWriter *writer);
+int getBlockedCell(const BlockedGrid *grid, const int x, const int y);
+int getBlockedMazeCell(const Maze *maze, const BlockedGrid *grid, const int cell);
+int moveBlocked(const BlockedGrid *grid, const int cell, const int dir);
+bool buildBlockedGrid(const Maze *maze, BlockedGrid *grid);
+void getShortestPathBlocked(Maze *maze, const int x, const int y, PathWriter *writer);
+int descendWeightedPath(const Maze *maze, const int *distance, int cell, int *path, const int length);
+void getShortestPathWeighted(Maze *maze, const int x, const int y, PathWriter *writer);
+bool buildWeightedField(const Maze *maze, Field *field);
+FILE *createTempFile(void);
+bool isTiledMap(const char *path);
+void convertTiled(const Options *options);
+bool flushTile(TileCache *cache, Tile *tile);
+Tile *getTile(TileCache *cache, const uint64_t id);
+int getTiledCell(const Tile *tile, const uint32_t cell);
+bool moveTiled(const TileCache *cache, uint64_t *tileId, uint32_t *cell, const int dir);
+int getTiledState(const Tile *tile, const uint32_t cell);
+void setTiledState(Tile *tile, const uint32_t cell, const int state);
+int compareRecords(const void *a, const void *b);
+bool spillFrontier(Frontier *frontier);
+bool pushFrontier(Frontier *frontier, const FrontierRecord *record);
+void clearFrontier(Frontier *frontier);
+bool openFrontierReader(FrontierReader *reader, Frontier *frontier);
+bool readFrontier(FrontierReader *reader, FrontierRecord *record);
+void closeFrontierReader(FrontierReader *reader);
+void freeTiledSearch(TiledSearch *search);
+void failTiledSearch(TiledSearch *search, const int errorCode);
+bool expandTiledCell(TiledSearch *search, const Tile *tile, const uint32_t cell);
+void printTiledPath(TiledSearch *search, uint64_t tileId, uint32_t cell, PathWriter *writer);
+void solveTiled(const Options *options);
+int descendPath(const Maze *maze, const int *distance, int cell, int *path, const int step);
+void printCellPath(const Maze *maze, const int *path, const int length, PathWriter *writer);
+void initPathWriter(PathWriter *writer, char *buffer, const size_t limit, const bool compact, FILE *output);
+bool reservePathWriter(PathWriter *writer, const size_t size);
+void flushPathWriter(PathWriter *writer);
+void writeText(PathWriter *writer, const char *text);
+void writeNumber(PathWriter *writer, uint64_t value);
+void writeRun(PathWriter *writer);
+void writePathCell(PathWriter *writer, const uint64_t x, const uint64_t y);
+void endPath(PathWriter *writer);
+int peekBucketQueue(BucketQueue *queue);
+void clearBucketQueue(BucketQueue *queue);
+int getCluster(const Maze *maze, const HpaIndex *index, const int cell);
+int findHpaNode(const Maze *maze, const HpaIndex *index, const int cell);
+bool appendCell(int **cells, int *count, int *limit, const int cell);
+bool addEntrances(const Maze *maze, const int first, const int step, const int across, const int length,
+                  const int side, int **cells, int *count, int *limit);
+bool collectClusterNodes(const Maze *maze, const HpaIndex *index, const int cluster,
+                         int **cells, int *count, int *limit);
+int compareCells(const void *a, const void *b);
+bool initHpaLocal(HpaLocal *local, const Maze *maze, const int clusterSize);
+void freeHpaLocal(HpaLocal *local);
+bool searchCluster(const Maze *maze, HpaLocal *local, const int source, const int target);
+int getLocalDistance(const Maze *maze, const HpaLocal *local, const int cell);
+bool buildHpaIndex(const Maze *maze, const int clusterSize, HpaIndex *index);
+bool appendHpaEdge(HpaIndex *index, int *limit, const int target, const int cost);
+void freeHpaIndex(HpaIndex *index);
+bool loadHpaIndex(const char *indexPath, const Maze *maze, const int clusterSize, const uint64_t hash,
+                  HpaIndex *index);
+void saveHpaIndex(const char *indexPath, const Maze *maze, const HpaIndex *index, const uint64_t hash);
+bool getHpaIndex(const Maze *maze, const Options *options, HpaIndex *index);
+bool initHpaSearch(HpaSearch *search, const Maze *maze, const HpaIndex *index);
+void freeHpaSearch(HpaSearch *search);
+bool printClusterPath(const Maze *maze, HpaLocal *local, const int cell, const int target, PathWriter *writer);
+bool printHpaPath(const Maze *maze, HpaSearch *search, const int start, PathWriter *writer);
+int getDirection(const Maze *maze, const int cell, const int next);
+bool initDynamicField(const Maze *maze, DynamicField *dynamic);
+void freeDynamicField(DynamicField *dynamic);
+bool appendSeed(DynamicField *dynamic, const int distance, const int cell);
+int compareSeeds(const void *a, const void *b);
+bool propagateDynamicField(const Maze *maze, DynamicField *dynamic);
+bool repairDynamicField(const Maze *maze, DynamicField *dynamic, const int *changed, const int changedCount);
+void printDynamicPath(const Maze *maze, const DynamicField *dynamic, const int x, const int y, PathWriter *writer);
+bool runDynamic(Maze *maze, DynamicField *dynamic, FILE *input, const int x, const int y, PathWriter *writer);
+void solveMaze(Maze *maze, const Options *options, PathWriter *writer);
+double getTime(void);
+void printBench(const char *algorithm, const uint64_t width, const uint64_t height, const double loadTime, const double solveTime);
+void printStats(void);
+#ifdef DUNGEON_STATS
+void markStatPhase(const int phase);
+void updateStatMax(atomic_ullong *counter, const unsigned long long value);
+void *statMalloc(const size_t size);
+void *statCalloc(const size_t count, const size_t size);
+void *statRealloc(void *ptr, const size_t size);
+#endif
+size_t getCellId(const void *ids, const size_t index, const bool wide);
+void setCellId(void *ids, const size_t index, const size_t value, const bool wide);
+void printShortestPath(Maze *maze, void *queue, size_t index, const bool wide, PathWriter *writer);
+int findRoot(int32_t *parent, int cell);
+void unionCells(int32_t *parent, const int first, const int second);
+void *labelBand(void *arg);
+bool buildComponents(const Maze *maze, const int threadCount, Components *components);
+void freeComponents(Components *components);
+bool loadComponentCache(const char *cachePath, const Maze *maze, const uint64_t hash, Components *components);
+void saveComponentCache(const char *cachePath, const Maze *maze, const Components *components, const uint64_t hash);
+bool getComponents(const Maze *maze, const Options *options, Components *components);
+void runDaemon(const int argc, char const *argv[], const Options *options);
+void freeDaemon(Daemon *daemon);
+bool pushDaemonJob(Daemon *daemon, const DaemonJob *job);
+bool popDaemonJob(Daemon *daemon, DaemonJob *job);
+void answerDaemonQuery(const Daemon *daemon, DaemonWorker *worker, const char *line);
+void stopDaemon(const int signal);
+void wakeDaemon(const Daemon *daemon);
+bool serveClients(Daemon *daemon, const int listenFd);
+bool acceptClient(Daemon *daemon, const int listenFd);
+void readClient(Daemon *daemon, DaemonClient *client);
+void pushClientLine(Daemon *daemon, DaemonClient *client);
+void sendClient(Daemon *daemon, DaemonClient *client);
+void addClientAnswer(Daemon *daemon, DaemonWorker *worker, const DaemonJob *job);
+void removeClients(Daemon *daemon);
+void *serveDaemon(void *arg);
+int openDaemonSocket(const char *path);
 
 int main(int argc, char const *argv[])
 {
-    FILE *fPtr;
-    int x, y;
+    Options options;
+    readOptions(argc, argv, &options);
+
+    if (options.daemonMode)
+    {
+        // the maps are loaded once and the queries are answered until the input ends.
+        runDaemon(argc, argv, &options);
+        return 0;
+    }
+    else if (options.convertTiled)
+    {
+        convertTiled(&options);
+        return 0;
+    }
+    else if (options.convertBinary)
+    {
+        convertBinary(&options);
+        return 0;
+    }
+    else if (isTiledMap(options.path))
+    {
+        // the tiled map is never loaded as a whole, so only the out-of-core BFS can solve it.
+        if (options.algorithm != ALGO_BFS || options.layout != LAYOUT_ROWS || options.queryMode ||
+            options.dynamicMode || options.components || options.useCache)
+        {
+            errorHandle(1);
+        }
+
+        STAT_PHASE(PHASE_SOLVE);
+        solveTiled(&options);
+
+        if (options.stats)
+        {
+            printStats();
+        }
+        return 0;
+    }
+
+    STAT_PHASE(PHASE_PARSE);
+    const double loadStart = getTime();
+    Maze maze;
+    getMaze(options.path, &maze);
+
+    if (!fitsCellIds(&options, &maze))
+    {
+        freeMaze(&maze);
+        errorHandle(9);
+    }
+
+    char outputBuffer[OUTPUT_BUFFER_SIZE];
+    PathWriter writer;
+    initPathWriter(&writer, outputBuffer, OUTPUT_BUFFER_SIZE, options.compact, stdout);
 
-    // use the value of argc to detect two different input methods.
-    if (argc == 4)
+    if (options.queryMode)
     {
-        x = readCoordinate(argv[2]);
-        y = readCoordinate(argv[3]);
+        FILE *input = stdin;
+        if (options.queryPath != NULL)
+        {
+            input = fopen(options.queryPath, "r");
+            if (input == NULL)
+            {
+                freeMaze(&maze);
+                errorHandle(6);
+            }
+        }
+
+        // one BFS from the exits answers all the queries,
+        // or each query searches the hierarchical index.
+        const bool useIndex = options.algorithm == ALGO_HPA;
+        Field field;
+        HpaIndex index;
+        HpaSearch search;
+
+        STAT_PHASE(PHASE_SOLVE);
+        bool ready = useIndex ? getHpaIndex(&maze, &options, &index) : getField(&maze, &options, &field);
+        if (ready && useIndex && !initHpaSearch(&search, &maze, &index))
+        {
+            freeHpaIndex(&index);
+            ready = false;
+        }
+
+        bool answered = ready && answerQueries(&maze, useIndex ? NULL : &field, useIndex ? &search : NULL, input, &writer);
+
+        if (input != stdin)
+        {
+            fclose(input);
+        }
+        if (ready && useIndex)
+        {
+            freeHpaSearch(&search);
+            freeHpaIndex(&index);
+        }
+        else if (ready)
+        {
+            freeField(&field);
+        }
+        freeMaze(&maze);
+
+        if (!answered)
+        {
+            errorHandle(5);
+        }
+        if (options.stats)
+        {
+            printStats();
+        }
+        return 0;
+    }
+    else if (options.dynamicMode)
+    {
+        FILE *input = stdin;
+        if (options.dynamicPath != NULL)
+        {
+            input = fopen(options.dynamicPath, "r");
+            if (input == NULL)
+            {
+                freeMaze(&maze);
+                errorHandle(6);
+            }
+        }
+
+        // the distance field is repaired after each batch of toggles.
+        DynamicField dynamic;
+        STAT_PHASE(PHASE_SOLVE);
+        bool finished = initDynamicField(&maze, &dynamic);
+        if (finished)
+        {
+            finished = runDynamic(&maze, &dynamic, input, options.x, options.y, &writer);
+            freeDynamicField(&dynamic);
+        }
+
+        if (input != stdin)
+        {
+            fclose(input);
+        }
+        freeMaze(&maze);
+
+        if (!finished)
+        {
+            errorHandle(5);
+        }
+        if (options.stats)
+        {
+            printStats();
+        }
+        return 0;
+    }
+
+    // If the route exists, it will be printed in "solveMaze".
+    const double solveStart = getTime();
+    STAT_PHASE(PHASE_SOLVE);
+    solveMaze(&maze, &options, &writer);
+
+    if (options.bench)
+    {
+        const char *names[] = {"bfs", "bidirectional", "astar", "jps", "parallel", "dobfs", "hpa"};
+        printBench(maze.weighted ? "weighted" : names[options.algorithm], maze.width, maze.height,
+                   solveStart - loadStart, getTime() - solveStart);
+    }
+    if (options.stats)
+    {
+        printStats();
+    }
+    freeMaze(&maze);
+
+    return 0;
+}
+
+// This function is used to exit the program.
+// Use error-code to prompt different error messages.
+void errorHandle(const int errorCode)
+{
+    if (errorCode < 1 || errorCode > 9)
+    {
+        // handle invalid errorCode
+        return;
+    }
+
+    switch (errorCode)
+    {
+        case 1:
+            puts("Invalid command line arguments. Usage: [--algo=bfs|bidirectional|astar|jps|parallel|dobfs|hpa] [--layout=rows|blocked] [--threads=n] [--cache] [--bench] [--stats] [--compact] [--components] [filename] <x> <y>");
+            puts("       --queries[=file] [--algo=hpa] [--cluster-size=n] [--cache] [filename]");
+            puts("       --algo=hpa prints near-shortest paths, which can be longer than the BFS path.");
+            puts("       --dynamic[=file] [filename] <x> <y>");
+            puts("       --daemon[=socket] [--threads=n] [--cache] [--compact] <[name=]map>...");
+            puts("       --convert <map> <binary map>");
+            puts("       --convert-tiled [--tile-size=n] <map> <tiled map>");
+            puts("       [--tile-cache=n] [--bench] [--stats] [--compact] <tiled map> <x> <y>");
+            break;
+
+        case 2:
+            puts("Invalid dungeon file!");
+            break;
+
+        case 3:
+            // Print the specific error message in this situation.
+            perror("Error reading dungeon file");
+            break;
+
+        case 4:
+            puts("Invalid starting location!");
+            break;
+
+        case 5:
+            puts("Unable to allocate memory.");
+            break;
+
+        case 6:
+            perror("Error reading query file");
+            break;
+
+        case 7:
+            perror("Error writing output file");
+            break;
+
+        case 8:
+            perror("Error opening daemon socket");
+            break;
+
+        case 9:
+            puts("The dungeon is too large for this mode, use \"--algo=bfs\" or a tiled map.");
+            break;
+    }
+
+    exit(errorCode);
+}
+
+// This function is used to read coordinate (x,y).
+// It calls "errorHandle" fucntion when error occurs.
+int readCoordinate(const char *string)
+{
+    char *endPtr;
+    long num = strtol(string, &endPtr, 10);
+
+    // If the string contain any non-digit char, it's invalid.
+    // If the value is negative, it's also invalid.
+    if (*endPtr != '\0' || num < 0)
+    {
+        errorHandle(1);
+    }
+
+    // Check the convertion from long to int is safe.
+    if (num > INT_MAX || num < INT_MIN)
+    {
+        errorHandle(1);
+    }
+
+    return (int)num;
+}
+
+// This function reads the options and the positional arguments.
+// It calls "errorHandle" fucntion when error occurs.
+void readOptions(const int argc, char const *argv[], Options *options)
+{
+    const char *args[3];
+    int count = 0;
+
+    options->algorithm = ALGO_BFS;
+    options->layout = LAYOUT_ROWS;
+    options->queryMode = false;
+    options->queryPath = NULL;
+    options->dynamicMode = false;
+    options->bench = false;
+    options->stats = false;
+    options->compact = false;
+    options->components = false;
+    options->daemonMode = false;
+    options->daemonPath = NULL;
+    options->dynamicPath = NULL;
+    options->useCache = false;
+    options->convertTiled = false;
+    options->convertBinary = false;
+    options->outputPath = NULL;
+    options->tileSize = TILE_SIZE;
+    options->tileCacheSize = TILE_CACHE_SIZE;
+    options->clusterSize = CLUSTER_SIZE;
+    options->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (options->threads < 1 || options->threads > MAX_THREADS)
+    {
+        options->threads = (options->threads < 1) ? 1 : MAX_THREADS;
+    }
 
-        fPtr = fopen(argv[1], "r");
-        if (fPtr == NULL)
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bidirectional") == 0 || strcmp(argv[i], "--algo=bidirectional") == 0)
+        {
+            options->algorithm = ALGO_BIDIRECTIONAL;
+        }
+        else if (strcmp(argv[i], "--algo=bfs") == 0)
+        {
+            options->algorithm = ALGO_BFS;
+        }
+        else if (strcmp(argv[i], "--algo=astar") == 0)
+        {
+            options->algorithm = ALGO_ASTAR;
+        }
+        else if (strcmp(argv[i], "--algo=jps") == 0)
         {
-            errorHandle(3);
+            options->algorithm = ALGO_JPS;
         }
+        else if (strcmp(argv[i], "--algo=parallel") == 0)
+        {
+            options->algorithm = ALGO_PARALLEL;
+        }
+        else if (strcmp(argv[i], "--algo=dobfs") == 0)
+        {
+            options->algorithm = ALGO_DOBFS;
+        }
+        else if (strcmp(argv[i], "--algo=hpa") == 0)
+        {
+            options->algorithm = ALGO_HPA;
+        }
+        else if (strcmp(argv[i], "--layout=rows") == 0)
+        {
+            options->layout = LAYOUT_ROWS;
+        }
+        else if (strcmp(argv[i], "--layout=blocked") == 0)
+        {
+            options->layout = LAYOUT_BLOCKED;
+        }
+        else if (strncmp(argv[i], "--cluster-size=", 15) == 0)
+        {
+            options->clusterSize = readOptionNumber(argv[i] + 15, 2, MAX_CLUSTER_SIZE);
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            options->threads = readOptionNumber(argv[i] + 10, 1, MAX_THREADS);
+        }
+        else if (strcmp(argv[i], "--convert") == 0)
+        {
+            options->convertBinary = true;
+        }
+        else if (strcmp(argv[i], "--convert-tiled") == 0)
+        {
+            options->convertTiled = true;
+        }
+        else if (strncmp(argv[i], "--tile-size=", 12) == 0)
+        {
+            options->tileSize = readOptionNumber(argv[i] + 12, 8, MAX_TILE_SIZE);
+
+            // each byte of a tile holds 4 cells.
+            if (options->tileSize % 8 != 0)
+            {
+                errorHandle(1);
+            }
+        }
+        else if (strncmp(argv[i], "--tile-cache=", 13) == 0)
+        {
+            options->tileCacheSize = readOptionNumber(argv[i] + 13, 1, INT_MAX);
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            options->useCache = true;
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            options->bench = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            options->stats = true;
+        }
+        else if (strcmp(argv[i], "--compact") == 0)
+        {
+            options->compact = true;
+        }
+        else if (strcmp(argv[i], "--components") == 0)
+        {
+            options->components = true;
+        }
+        else if (strcmp(argv[i], "--daemon") == 0)
+        {
+            options->daemonMode = true;
+        }
+        else if (strncmp(argv[i], "--daemon=", 9) == 0)
+        {
+            options->daemonMode = true;
+            options->daemonPath = argv[i] + 9;
+        }
+        else if (strcmp(argv[i], "--dynamic") == 0)
+        {
+            options->dynamicMode = true;
+        }
+        else if (strncmp(argv[i], "--dynamic=", 10) == 0)
+        {
+            options->dynamicMode = true;
+            options->dynamicPath = argv[i] + 10;
+        }
+        else if (strcmp(argv[i], "--queries") == 0)
+        {
+            options->queryMode = true;
+        }
+        else if (strncmp(argv[i], "--queries=", 10) == 0)
+        {
+            options->queryMode = true;
+            options->queryPath = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            // unknown option.
+            errorHandle(1);
+        }
+        else
+        {
+            // the daemon can load any number of maps, the other modes check the count later.
+            if (count < 3)
+            {
+                args[count] = argv[i];
+            }
+            count++;
+        }
+    }
+
+    // the maps of the daemon are read from "argv" again when they are loaded.
+    if (options->daemonMode)
+    {
+        if (count == 0 || options->queryMode || options->dynamicMode ||
+            options->convertTiled || options->convertBinary)
+        {
+            errorHandle(1);
+        }
+        return;
+    }
+
+    // only the BFS has a blocked layout.
+    if (options->layout == LAYOUT_BLOCKED && options->algorithm != ALGO_BFS)
+    {
+        errorHandle(1);
+    }
+
+    // the map is converted instead of solved.
+    if (options->convertTiled || options->convertBinary)
+    {
+        if (count != 2 || options->queryMode || (options->convertTiled && options->convertBinary))
+        {
+            errorHandle(1);
+        }
+
+        options->path = args[0];
+        options->outputPath = args[1];
+        return;
+    }
+
+    // the starting locations of queries are read later.
+    if (options->queryMode)
+    {
+        if (count > 1 || options->dynamicMode)
+        {
+            errorHandle(1);
+        }
+
+        options->path = (count == 1) ? args[0] : "dungeon.map";
+        return;
+    }
+
+    // use the number of arguments to detect two different input methods.
+    if (count == 3)
+    {
+        options->path = args[0];
+        options->x = readCoordinate(args[1]);
+        options->y = readCoordinate(args[2]);
+    }
+    else if (count == 2)
+    {
+        options->path = "dungeon.map";
+        options->x = readCoordinate(args[0]);
+        options->y = readCoordinate(args[1]);
+    }
+    else
+    {
+        errorHandle(1);
+    }
+}
+
+// This function reads the number of an option, which must be between "min" and "max".
+// It calls "errorHandle" fucntion when error occurs.
+int readOptionNumber(const char *string, const int min, const int max)
+{
+    char *endPtr;
+    long num = strtol(string, &endPtr, 10);
+
+    if (*string == '\0' || *endPtr != '\0' || num < min || num > max)
+    {
+        errorHandle(1);
+    }
+
+    return (int)num;
+}
+
+// This function reads the whole stream "fd" into a buffer.
+// It is the fallback for pipes and other files that cannot be mapped.
+// It returns NULL when error occurs, "errno" tells the reason.
+char *readStream(const int fd, size_t *size)
+{
+    size_t limit = STREAM_CHUNK_SIZE;
+    size_t length = 0;
+
+    char *buffer = malloc(sizeof(char) * limit);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    while (true)
+    {
+        // malloc more memory when reach the limit
+        if (length == limit)
+        {
+            limit *= 2;
+            char *newBuffer = realloc(buffer, sizeof(char) * limit);
+            if (newBuffer == NULL)
+            {
+                free(buffer);
+                return NULL;
+            }
+            buffer = newBuffer;
+        }
+
+        ssize_t count = read(fd, buffer + length, limit - length);
+        if (count == 0)
+        {
+            break;
+        }
+        else if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            free(buffer);
+            return NULL;
+        }
+
+        length += count;
+    }
+
+    *size = length;
+    return buffer;
+}
+
+// This function maps the dungeon file into memory.
+// Pipes and other unmappable files are read into a buffer instead.
+// It calls "errorHandle" fucntion when error occurs.
+void loadMazeFile(const char *path, Maze *maze)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        errorHandle(3);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        close(fd);
+        errorHandle(3);
+    }
+
+    maze->data = NULL;
+    maze->mapped = false;
+    maze->regular = S_ISREG(info.st_mode);
+    maze->cellCount = 0;
+    maze->exits = NULL;
+    maze->exitCount = 0;
+    maze->exitLimit = 0;
+    maze->exitMinX = maze->exitMaxX = 0;
+    maze->exitMinY = maze->exitMaxY = 0;
+
+    // only floors and exits can be entered without a legend, both cost 1.
+    memset(maze->costs, 0, sizeof(maze->costs));
+    maze->costs['.'] = 1;
+    maze->costs['x'] = 1;
+    maze->hasLegend = false;
+    maze->weighted = false;
+    maze->maxCost = 1;
+
+    if (S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        // the pages are private, so "--dynamic" can change the walls without changing the file.
+        void *data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // the file is scanned once from the beginning to the end.
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+            maze->data = data;
+            maze->dataSize = info.st_size;
+            maze->mapped = true;
+        }
+    }
+
+    if (!maze->mapped)
+    {
+        maze->data = readStream(fd, &maze->dataSize);
+        if (maze->data == NULL)
+        {
+            int error = errno;
+            close(fd);
+            errno = error;
+            errorHandle(error == ENOMEM ? 5 : 3);
+        }
+    }
+
+    close(fd);
+}
+
+// This function free the memory used by the maze.
+void freeMaze(Maze *maze)
+{
+    free(maze->exits);
+    maze->exits = NULL;
+
+    if (maze->data == NULL)
+    {
+        return;
+    }
+
+    if (maze->mapped)
+    {
+        munmap(maze->data, maze->dataSize);
+    }
+    else
+    {
+        free(maze->data);
+    }
+
+    maze->data = NULL;
+}
+
+// This function reads a non-negative decimal number starting at "*offset".
+// It returns -1 if there is no number or the number is too large.
+int readNumber(const Maze *maze, size_t *offset)
+{
+    size_t index = *offset;
+    long num = 0;
+
+    if (index >= maze->dataSize || !isdigit((unsigned char)maze->data[index]))
+    {
+        return -1;
+    }
+
+    while (index < maze->dataSize && isdigit((unsigned char)maze->data[index]))
+    {
+        num = num * 10 + (maze->data[index] - '0');
+        if (num > INT_MAX)
+        {
+            return -1;
+        }
+        index++;
+    }
+
+    *offset = index;
+    return (int)num;
+}
+
+// This function is used to read the maze's width and height.
+// It returns the offset of the first row.
+// It calls "errorHandle" fucntion when error occurs.
+size_t getMazeSize(Maze *maze)
+{
+    size_t offset = 0;
+
+    // If the file starts with a non-digit char, it's invalid.
+    maze->width = readNumber(maze, &offset);
+
+    // the two numbers are separated by whitespace.
+    size_t separator = offset;
+    while (offset < maze->dataSize && isspace((unsigned char)maze->data[offset]))
+    {
+        offset++;
+    }
+
+    maze->height = readNumber(maze, &offset);
+
+    if (maze->width == -1 || offset == separator || maze->height == -1)
+    {
+        freeMaze(maze);
+        errorHandle(2);
+    }
+
+    // check whether there is any invalid character after two numbers.
+    if (offset >= maze->dataSize || maze->data[offset] != '\n')
+    {
+        freeMaze(maze);
+        errorHandle(2);
+    }
+
+    return offset + 1;
+}
+
+// This function reads the optional legend after the maze's width and height.
+// Each line of the legend is ":<glyph> <cost>", and the glyph costs "cost" to enter.
+// It returns the offset of the first row.
+// It calls "errorHandle" fucntion when error occurs.
+size_t getLegend(Maze *maze, size_t offset)
+{
+    while (offset < maze->dataSize && maze->data[offset] == ':')
+    {
+        // the glyph can't be a reserved char or be defined twice.
+        if (offset + 3 >= maze->dataSize)
+        {
+            freeMaze(maze);
+            errorHandle(2);
+        }
+
+        const unsigned char glyph = maze->data[offset + 1];
+        if (!isgraph(glyph) || isdigit(glyph) || glyph == '#' || glyph == ':' ||
+            maze->costs[glyph] != 0 || maze->data[offset + 2] != ' ')
+        {
+            freeMaze(maze);
+            errorHandle(2);
+        }
+
+        offset += 3;
+        int cost = readNumber(maze, &offset);
+        if (cost < 1 || cost > MAX_TERRAIN_COST || offset >= maze->dataSize || maze->data[offset] != '\n')
+        {
+            freeMaze(maze);
+            errorHandle(2);
+        }
+
+        maze->costs[glyph] = cost;
+        maze->hasLegend = true;
+        offset++;
+    }
+
+    return offset;
+}
+
+// This function checks one row of the maze.
+// It returns the number of exits in this row, or -1 if the row is invalid.
+int scanRow(const char *row, const int width)
+{
+    int count = 0;
+    int col = 0;
+
+#ifdef __SSE2__
+    const __m128i floorChars = _mm_set1_epi8('.');
+    const __m128i wallChars = _mm_set1_epi8('#');
+    const __m128i exitChars = _mm_set1_epi8('x');
+
+    // check 16 chars at a time.
+    for (; col + 16 <= width; col += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(row + col));
+        __m128i isExit = _mm_cmpeq_epi8(chunk, exitChars);
+        __m128i isValid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, floorChars),
+                                                     _mm_cmpeq_epi8(chunk, wallChars)),
+                                       isExit);
+
+        if (_mm_movemask_epi8(isValid) != 0xFFFF)
+        {
+            return -1;
+        }
+
+        count += __builtin_popcount(_mm_movemask_epi8(isExit));
+    }
+#endif
+
+    // check the remaining chars one by one.
+    for (; col < width; ++col)
+    {
+        char tmp = row[col];
+
+        // check whether this location is valid.
+        if (tmp != '.' && tmp != '#' && tmp != 'x')
+        {
+            return -1;
+        }
+
+        // update the number of exits.
+        if (tmp == 'x')
+        {
+            count++;
+        }
+    }
+
+    // check the last char of this line.
+    if (row[width] != '\n')
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+// This function checks one row of a maze with a legend, using the cost of each glyph.
+// "weighted" is set if the row has a glyph which doesn't cost 1.
+// It returns the number of exits in this row, or -1 if the row is invalid.
+int scanRowWithLegend(const Maze *maze, const char *row, bool *weighted)
+{
+    int count = 0;
+
+    for (int col = 0; col < maze->width; ++col)
+    {
+        const unsigned char tmp = row[col];
+
+        if (tmp == 'x')
+        {
+            count++;
+        }
+        else if (maze->costs[tmp] == 0 && tmp != '#')
+        {
+            return -1;
+        }
+        else if (maze->costs[tmp] > 1)
+        {
+            *weighted = true;
+        }
+    }
+
+    // check the last char of this line.
+    if (row[maze->width] != '\n')
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+// This function loads the maze from the file "path".
+// The rows are used in place, so the maze is not copied.
+// It calls "errorHandle" fucntion when error occurs.
+void getMaze(const char *path, Maze *maze)
+{
+    loadMazeFile(path, maze);
+
+    // a binary map is decoded into the same rows as a text map.
+    if (isBinaryMaze(maze))
+    {
+        // the runs are checked while they are decoded.
+        STAT_PHASE(PHASE_VALIDATE);
+        decodeBinaryMaze(maze);
+    }
+    else
+    {
+        size_t offset = getLegend(maze, getMazeSize(maze));
+        maze->stride = (size_t)maze->width + 1;
+        maze->cells = maze->data + offset;
+        STAT_PHASE(PHASE_VALIDATE);
+
+        // the file must contain all the rows.
+        if ((maze->dataSize - offset) / maze->stride < (size_t)maze->height)
+        {
+            freeMaze(maze);
+            errorHandle(2);
+        }
+
+        // a maze can have any number of exits.
+        for (int row = 0; row < maze->height; ++row)
+        {
+            const char *line = maze->cells + row * maze->stride;
+            int rowCount = maze->hasLegend ? scanRowWithLegend(maze, line, &maze->weighted)
+                                           : scanRow(line, maze->width);
+
+            if (rowCount == -1)
+            {
+                freeMaze(maze);
+                errorHandle(2);
+            }
+
+            // only the rows with exits are searched again.
+            const char *exitPtr = line;
+            for (int i = 0; i < rowCount; ++i)
+            {
+                exitPtr = memchr(exitPtr, 'x', line + maze->width - exitPtr);
+                if (!appendExit(maze, exitPtr - line, row))
+                {
+                    freeMaze(maze);
+                    errorHandle(5);
+                }
+                exitPtr++;
+            }
+        }
+    }
+
+    // each side is at most "INT_MAX", so the count of cells always fits.
+    maze->cellCount = (uint64_t)maze->width * maze->height;
+
+    // the weighted search only needs as many buckets as the largest cost.
+    for (int i = 0; i < 256; ++i)
+    {
+        maze->maxCost = (maze->costs[i] > maze->maxCost) ? maze->costs[i] : maze->maxCost;
+    }
+}
+
+// This function checks whether the map can be searched in the chosen mode.
+// The most searches keep 32-bit cell IDs in their queues, so the map must fit in them.
+// Only the BFS over the rows works with any number of cells.
+bool fitsCellIds(const Options *options, const Maze *maze)
+{
+    // only these modes search the map with the solver chosen by "--algo".
+    const bool searches = !options->queryMode && !options->dynamicMode && !options->daemonMode &&
+                          !options->useCache && !maze->weighted;
+    uint64_t cells = maze->cellCount;
+    uint64_t limit = MAX_CELL_COUNT;
+
+    if (searches && options->algorithm == ALGO_JPS)
+    {
+        // a node of JPS is "cell * 4 + direction".
+        limit = MAX_CELL_COUNT / 4;
+    }
+    else if (searches && options->algorithm == ALGO_BIDIRECTIONAL)
+    {
+        // the bidirectional BFS numbers the cells "y * stride + x".
+        cells = (uint64_t)maze->stride * maze->height;
+    }
+    else if (searches && options->algorithm == ALGO_BFS && options->layout == LAYOUT_BLOCKED)
+    {
+        // the blocked grid has a border of walls and is made of whole blocks.
+        const uint64_t blocksX = ((uint64_t)maze->width + 2 + BLOCK_SIDE - 1) / BLOCK_SIDE;
+        const uint64_t blocksY = ((uint64_t)maze->height + 2 + BLOCK_SIDE - 1) / BLOCK_SIDE;
+        cells = blocksX * blocksY * BLOCK_CELLS;
+    }
+
+    if (cells <= limit)
+    {
+        return true;
+    }
+
+    return searches && !options->components && options->algorithm == ALGO_BFS && options->layout == LAYOUT_ROWS;
+}
+
+// This function records the exit at (x, y) and updates the box around all exits.
+// It returns false when it's unable to allocate memory.
+bool appendExit(Maze *maze, const int x, const int y)
+{
+    // malloc more memory when reach the limit
+    if (maze->exitCount == maze->exitLimit)
+    {
+        // the count of exits is an "int" too.
+        if (maze->exitLimit > INT_MAX / 2)
+        {
+            return false;
+        }
+
+        int limit = maze->exitLimit == 0 ? EXIT_LIST_SIZE : maze->exitLimit * 2;
+        int64_t *exits = realloc(maze->exits, sizeof(int64_t) * limit);
+        if (exits == NULL)
+        {
+            return false;
+        }
+
+        maze->exits = exits;
+        maze->exitLimit = limit;
+    }
+
+    if (maze->exitCount == 0)
+    {
+        maze->exitMinX = maze->exitMaxX = x;
+        maze->exitMinY = maze->exitMaxY = y;
+    }
+    else
+    {
+        maze->exitMinX = (x < maze->exitMinX) ? x : maze->exitMinX;
+        maze->exitMaxX = (x > maze->exitMaxX) ? x : maze->exitMaxX;
+        maze->exitMinY = (y < maze->exitMinY) ? y : maze->exitMinY;
+        maze->exitMaxY = (y > maze->exitMaxY) ? y : maze->exitMaxY;
+    }
+
+    maze->exits[maze->exitCount++] = (int64_t)y * maze->width + x;
+    return true;
+}
+
+// This function writes "value" as a varint, 7 bits per byte from the lowest bits.
+// It returns false when error occurs.
+bool writeVarint(FILE *fPtr, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        if (putc((int)(value & 0x7F) | 0x80, fPtr) == EOF)
+        {
+            return false;
+        }
+        value >>= 7;
+    }
+
+    return putc((int)value, fPtr) != EOF;
+}
+
+// This function reads a varint written by "writeVarint".
+// It returns false if the varint is truncated or too long.
+bool readVarint(const Maze *maze, size_t *offset, uint32_t *value)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 35 && *offset < maze->dataSize; shift += 7)
+    {
+        const unsigned char byte = maze->data[(*offset)++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            *value = (uint32_t)result;
+            return result <= UINT32_MAX;
+        }
+    }
+
+    return false;
+}
+
+// This function converts a map into a binary map.
+// Each row is a list of runs, a glyph followed by the length of the run.
+// It calls "errorHandle" fucntion when error occurs.
+void convertBinary(const Options *options)
+{
+    Maze maze;
+    getMaze(options->path, &maze);
+
+    // the legend is every glyph except the floor and the exit, which always cost 1.
+    unsigned char legend[256][2];
+    uint32_t legendCount = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        if (maze.costs[i] != 0 && i != '.' && i != 'x')
+        {
+            legend[legendCount][0] = (unsigned char)i;
+            legend[legendCount][1] = maze.costs[i];
+            legendCount++;
+        }
+    }
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.width = maze.width;
+    header.height = maze.height;
+    header.exitCount = maze.exitCount;
+    header.legendCount = legendCount;
+
+    FILE *fPtr = fopen(options->outputPath, "wb");
+    if (fPtr == NULL)
+    {
+        freeMaze(&maze);
+        errorHandle(7);
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, fPtr) == 1;
+
+    for (int i = 0; i < maze.exitCount && written; ++i)
+    {
+        uint32_t point[2];
+        point[0] = maze.exits[i] % maze.width;
+        point[1] = maze.exits[i] / maze.width;
+        written = fwrite(point, sizeof(point), 1, fPtr) == 1;
+    }
+
+    if (written && legendCount > 0)
+    {
+        written = fwrite(legend, sizeof(legend[0]), legendCount, fPtr) == legendCount;
+    }
+
+    for (int row = 0; row < maze.height && written; ++row)
+    {
+        const char *line = maze.cells + row * maze.stride;
+
+        for (int col = 0; col < maze.width && written;)
+        {
+            int end = col + 1;
+            while (end < maze.width && line[end] == line[col])
+            {
+                end++;
+            }
+
+            written = putc((unsigned char)line[col], fPtr) != EOF && writeVarint(fPtr, end - col);
+            col = end;
+        }
+    }
+
+    freeMaze(&maze);
+
+    if (fclose(fPtr) != 0 || !written)
+    {
+        errorHandle(7);
+    }
+}
+
+// This function checks whether the loaded file is a binary map.
+bool isBinaryMaze(const Maze *maze)
+{
+    return maze->dataSize >= sizeof(BinaryHeader) &&
+           memcmp(maze->data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+}
+
+// This function decodes a binary map into the same rows as a text map.
+// The header and the legend are kept in front of the rows, so the cache hash still covers them.
+// It calls "errorHandle" fucntion when error occurs.
+void decodeBinaryMaze(Maze *maze)
+{
+    BinaryHeader header;
+    memcpy(&header, maze->data, sizeof(header));
+
+    const size_t exitBytes = (size_t)header.exitCount * sizeof(uint32_t) * 2;
+    const size_t prefix = sizeof(header) + exitBytes + (size_t)header.legendCount * 2;
+
+    // every row has at least one run of two bytes.
+    if (header.width > INT_MAX || header.height > INT_MAX || header.legendCount > 256 ||
+        prefix > maze->dataSize ||
+        (header.width > 0 && (maze->dataSize - prefix) / 2 < header.height))
+    {
+        freeMaze(maze);
+        errorHandle(2);
+    }
+
+    maze->width = header.width;
+    maze->height = header.height;
+    maze->stride = (size_t)maze->width + 1;
+
+    // the glyph can't be a reserved char or be defined twice.
+    const unsigned char *legend = (const unsigned char *)maze->data + sizeof(header) + exitBytes;
+    for (uint32_t i = 0; i < header.legendCount; ++i)
+    {
+        const unsigned char glyph = legend[i * 2];
+        const unsigned char cost = legend[i * 2 + 1];
+
+        if (!isgraph(glyph) || isdigit(glyph) || glyph == '#' || glyph == ':' ||
+            maze->costs[glyph] != 0 || cost < 1)
+        {
+            freeMaze(maze);
+            errorHandle(2);
+        }
+
+        maze->costs[glyph] = cost;
+        maze->hasLegend = true;
+    }
+
+    char *buffer = malloc(sizeof(char) * (prefix + maze->stride * maze->height));
+    if (buffer == NULL)
+    {
+        freeMaze(maze);
+        errorHandle(5);
+    }
+    memcpy(buffer, maze->data, prefix);
+
+    // each run is checked once, instead of each cell.
+    size_t offset = prefix;
+    uint64_t exitCells = 0;
+    bool valid = true;
+
+    for (int row = 0; row < maze->height && valid; ++row)
+    {
+        char *line = buffer + prefix + row * maze->stride;
+        uint32_t col = 0;
+
+        while (col < header.width && valid)
+        {
+            uint32_t length = 0;
+            const unsigned char glyph = (offset < maze->dataSize) ? maze->data[offset++] : 0;
+
+            valid = (glyph == '#' || maze->costs[glyph] != 0) &&
+                    readVarint(maze, &offset, &length) &&
+                    length > 0 && length <= header.width - col;
+            if (valid)
+            {
+                memset(line + col, glyph, length);
+                col += length;
+
+                exitCells += (glyph == 'x') ? length : 0;
+                maze->weighted = maze->weighted || maze->costs[glyph] > 1;
+            }
+        }
+
+        line[maze->width] = '\n';
+    }
+
+    // the exits in the header must be all the exits, in order.
+    const unsigned char *points = (const unsigned char *)maze->data + sizeof(header);
+    valid = valid && offset == maze->dataSize && exitCells == header.exitCount;
+
+    for (uint32_t i = 0; i < header.exitCount && valid; ++i)
+    {
+        uint32_t point[2];
+        memcpy(point, points + i * sizeof(point), sizeof(point));
+
+        const int64_t cell = (int64_t)point[1] * maze->width + point[0];
+        valid = point[0] < header.width && point[1] < header.height &&
+                buffer[prefix + point[1] * maze->stride + point[0]] == 'x' &&
+                (maze->exitCount == 0 || cell > maze->exits[maze->exitCount - 1]);
+
+        if (valid && !appendExit(maze, point[0], point[1]))
+        {
+            free(buffer);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+    }
+
+    if (!valid)
+    {
+        free(buffer);
+        freeMaze(maze);
+        errorHandle(2);
+    }
+
+    // the decoded rows replace the file.
+    int64_t *exits = maze->exits;
+    maze->exits = NULL;
+    freeMaze(maze);
+
+    maze->exits = exits;
+    maze->data = buffer;
+    maze->dataSize = prefix + maze->stride * maze->height;
+    maze->mapped = false;
+    maze->cells = buffer + prefix;
+}
+
+// This function checks the starting location before searching.
+// It returns true if the starting location is the exit, and the path is printed.
+// It calls "errorHandle" fucntion when error occurs.
+bool checkStartingLocation(Maze *maze, const int x, const int y)
+{
+    if (x >= maze->width || y >= maze->height)
+    {
+        // the starting location is out of the maze.
+        freeMaze(maze);
+        errorHandle(4);
+    }
+    else if (*(maze->cells + y * maze->stride + x) == '#')
+    {
+        // the starting location is a wall.
+        freeMaze(maze);
+        errorHandle(4);
+    }
+    else if (*(maze->cells + y * maze->stride + x) == 'x')
+    {
+        // the starting location is the exit.
+        printf("%d,%d\n", x, y);
+        return true;
+    }
+
+    return false;
+}
+
+// This function saves the cells next to "cell" which are not walls.
+// The cells are numbered row by row, and the order is up, down, left, right.
+// It returns the number of cells saved into "neighbours".
+int getNeighbours(const Maze *maze, const int cell, int *neighbours)
+{
+    const int width = maze->width;
+    const int x = cell % width;
+    const int y = cell / width;
+    const char *current = maze->cells + y * maze->stride + x;
+    int count = 0;
+
+    if (y > 0 && *(current - maze->stride) != '#')
+    {
+        neighbours[count++] = cell - width;
+    }
+    if (y < maze->height - 1 && *(current + maze->stride) != '#')
+    {
+        neighbours[count++] = cell + width;
+    }
+    if (x > 0 && *(current - 1) != '#')
+    {
+        neighbours[count++] = cell - 1;
+    }
+    if (x < width - 1 && *(current + 1) != '#')
+    {
+        neighbours[count++] = cell + 1;
+    }
+
+    return count;
+}
+
+// This function checks whether "cell" is an exit.
+bool isExit(const Maze *maze, const int cell)
+{
+    return *(maze->cells + (cell / maze->width) * maze->stride + cell % maze->width) == 'x';
+}
+
+// This function returns the cost of moving into "cell".
+int getCost(const Maze *maze, const int cell)
+{
+    const unsigned char content = *(maze->cells + (cell / maze->width) * maze->stride + cell % maze->width);
+
+    return maze->costs[content];
+}
+
+// This function uses BFS to find the shortest path.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPath(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    // a cell is "y * stride + x" here, so the '\n' at the end of each row stops the moves left and right.
+    // The IDs are 32-bit unless the map has more cells, which keeps the queue compact.
+    const size_t stride = maze->stride;
+    const size_t cells = stride * maze->height;
+    const bool wide = cells > UINT32_MAX;
+    const size_t idSize = wide ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    // each entry of the queue is a cell and the index of its parent in the queue,
+    // so only the bitset has the size of the map, and the queue grows with the cells reached.
+    uint64_t *visited = calloc(cells / 64 + 1, sizeof(uint64_t));
+    size_t limit = EXIT_LIST_SIZE;
+    void *queue = malloc(idSize * 2 * limit);
+    if (visited == NULL || queue == NULL)
+    {
+        free(visited);
+        free(queue);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    const size_t start = (size_t)y * stride + x;
+    visited[start / 64] |= (uint64_t)1 << (start % 64);
+    setCellId(queue, 0, start, wide);
+    setCellId(queue, 1, 0, wide);
+    size_t head = 0;
+    size_t tail = 1;
+    size_t exitIndex = 0;
+    STAT_ADD(enqueued, 1);
+
+    while (head < tail && exitIndex == 0)
+    {
+        const size_t current = getCellId(queue, head * 2, wide);
+
+        // the cells above and below are checked against the first and the last row.
+        const size_t next[4] = {current - stride, current + stride, current - 1, current + 1};
+        const bool inside[4] = {current >= stride, current + stride < cells, current > 0, true};
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!inside[i] || (visited[next[i] / 64] & ((uint64_t)1 << (next[i] % 64))))
+            {
+                continue;
+            }
+
+            const char content = maze->cells[next[i]];
+            if (content == '#' || content == '\n')
+            {
+                continue;
+            }
+
+            // malloc more memory when reach the limit
+            if (tail == limit)
+            {
+                void *newQueue = realloc(queue, idSize * 2 * limit * 2);
+                if (newQueue == NULL)
+                {
+                    free(visited);
+                    free(queue);
+                    freeMaze(maze);
+                    errorHandle(5);
+                }
+
+                queue = newQueue;
+                limit *= 2;
+            }
+
+            visited[next[i] / 64] |= (uint64_t)1 << (next[i] % 64);
+            setCellId(queue, tail * 2, next[i], wide);
+            setCellId(queue, tail * 2 + 1, head, wide);
+            tail++;
+            STAT_ADD(enqueued, 1);
+            STAT_MAX(maxFrontier, tail - head);
+
+            if (content == 'x')
+            {
+                exitIndex = tail - 1;
+                break;
+            }
+        }
+
+        head++;
+    }
+
+    // every cell before "head" has been expanded.
+    COUNT_EXPANDED(head);
+    free(visited);
+
+    if (exitIndex == 0)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        printShortestPath(maze, queue, exitIndex, wide, writer);
+    }
+
+    free(queue);
+}
+
+// This function returns the cell ID at "index" of "ids", the IDs are 64-bit if "wide" is true.
+size_t getCellId(const void *ids, const size_t index, const bool wide)
+{
+    return wide ? ((const uint64_t *)ids)[index] : ((const uint32_t *)ids)[index];
+}
+
+// This function sets the cell ID at "index" of "ids", the IDs are 64-bit if "wide" is true.
+void setCellId(void *ids, const size_t index, const size_t value, const bool wide)
+{
+    if (wide)
+    {
+        ((uint64_t *)ids)[index] = value;
+    }
+    else
+    {
+        ((uint32_t *)ids)[index] = (uint32_t)value;
+    }
+}
+
+// This function uses bidirectional BFS to find the shortest path.
+// One frontier grows from the start and the other from all the exits,
+// the smaller frontier is always expanded by one whole level.
+// On a grid the two frontiers together still cover about as many cells as the BFS,
+// since the cells within "d" steps of a cell grow with "d" squared, not exponentially.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathBidirectional(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    BidirectionalSearch search;
+    if (!initBidirectionalSearch(&search, maze))
+    {
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    bool printed = searchBidirectional(maze, &search, y * maze->width + x, writer);
+    freeBidirectionalSearch(&search);
+
+    if (!printed)
+    {
+        freeMaze(maze);
+        errorHandle(5);
+    }
+}
+
+// This function prepares the buffers used by the bidirectional BFS.
+// Only the bitsets are cleared, the other buffers are written when a cell is reached.
+// It returns false when error occurs.
+bool initBidirectionalSearch(BidirectionalSearch *search, const Maze *maze)
+{
+    const int cells = (int)maze->stride * maze->height;
+    search->visited = calloc((cells / 64 + 1) * 2, sizeof(uint64_t));
+    bool ready = search->visited != NULL;
+
+    for (int side = 0; side < 2; ++side)
+    {
+        search->queue[side] = malloc(sizeof(int) * cells);
+        search->parents[side] = malloc(sizeof(int) * cells);
+        search->tail[side] = 0;
+
+        ready = ready && search->queue[side] != NULL && search->parents[side] != NULL;
+    }
+
+    if (!ready)
+    {
+        freeBidirectionalSearch(search);
+    }
+    return ready;
+}
+
+// This function frees the buffers used by the bidirectional BFS.
+void freeBidirectionalSearch(BidirectionalSearch *search)
+{
+    free(search->visited);
+    for (int side = 0; side < 2; ++side)
+    {
+        free(search->queue[side]);
+        free(search->parents[side]);
+    }
+}
+
+// This function searches from "start" and from all the exits at once, and prints the path.
+// The frontiers first meet between the last levels of both sides, so the first meeting is a shortest path.
+// It returns false when error occurs.
+bool searchBidirectional(const Maze *maze, BidirectionalSearch *search, const int start, PathWriter *writer)
+{
+    uint64_t *visited = search->visited;
+    int **queue = search->queue;
+    int **parents = search->parents;
+    const int width = maze->width;
+    const int stride = (int)maze->stride;
+    const int cells = stride * maze->height;
+
+    // only the cells reached by the last search are reset.
+    for (int side = 0; side < 2; ++side)
+    {
+        for (int i = 0; i < search->tail[side]; ++i)
+        {
+            visited[queue[side][i] / 64 * 2 + side] = 0;
+        }
+    }
+
+    // the search from the exits starts from all of them at once.
+    int head[2] = {0, 0};
+    int *tail = search->tail;
+    tail[0] = 1;
+    tail[1] = maze->exitCount;
+    const int startId = (start / width) * stride + start % width;
+    queue[0][0] = startId;
+    parents[0][0] = -1;
+    visited[startId / 64 * 2] |= (uint64_t)1 << (startId % 64);
+    for (int i = 0; i < maze->exitCount; ++i)
+    {
+        const int exit = (maze->exits[i] / width) * stride + maze->exits[i] % width;
+        queue[1][i] = exit;
+        parents[1][i] = -1;
+        visited[exit / 64 * 2 + 1] |= (uint64_t)1 << (exit % 64);
+    }
+    STAT_ADD(enqueued, 1 + maze->exitCount);
+
+    // "depth" is the distance of the level each side expands next,
+    // and "meet" has the queue indices of the meeting cells, "meet[0]" is on the start side.
+    int depth[2] = {0, 0};
+    int meet[2] = {-1, -1};
+
+    while (meet[0] == -1 && head[0] < tail[0] && head[1] < tail[1])
+    {
+        // expand the smaller frontier.
+        const int side = (tail[0] - head[0] <= tail[1] - head[1]) ? 0 : 1;
+        const int other = 1 - side;
+        const int levelEnd = tail[side];
+
+        while (head[side] < levelEnd && meet[0] == -1)
+        {
+            const int current = queue[side][head[side]];
+
+            // the cells above and below are checked against the first and the last row.
+            const int next[4] = {current - stride, current + stride, current - 1, current + 1};
+            const bool inside[4] = {current >= stride, current + stride < cells, current > 0, true};
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!inside[i] || maze->cells[next[i]] == '#' || maze->cells[next[i]] == '\n')
+                {
+                    continue;
+                }
+
+                uint64_t *words = &visited[next[i] / 64 * 2];
+                const uint64_t bit = (uint64_t)1 << (next[i] % 64);
+                if (words[other] & bit)
+                {
+                    meet[side] = head[side];
+                    meet[other] = findQueuedCell(queue[other], head[other], tail[other], next[i]);
+                    break;
+                }
+
+                if (!(words[side] & bit))
+                {
+                    words[side] |= bit;
+                    queue[side][tail[side]] = next[i];
+                    parents[side][tail[side]] = head[side];
+                    tail[side]++;
+                    STAT_ADD(enqueued, 1);
+                }
+            }
+
+            head[side]++;
+        }
+
+        if (meet[0] == -1)
+        {
+            depth[side]++;
+        }
+        STAT_MAX(maxFrontier, (tail[0] - head[0]) + (tail[1] - head[1]));
+    }
+
+    // every cell before "head" has been expanded on both sides.
+    COUNT_EXPANDED(head[0] + head[1]);
+
+    if (meet[0] == -1)
+    {
+        printf("%d,%d\n", start % width, start / width);
+        puts("No escape possible.");
+        return true;
+    }
+
+    STAT_PHASE(PHASE_PATH);
+    const int length = depth[0] + depth[1] + 2;
+    int *path = malloc(sizeof(int) * length);
+    if (path == NULL)
+    {
+        return false;
+    }
+
+    // stitch the two halves together at the meeting point, and number the cells row by row again.
+    for (int index = meet[0], i = depth[0]; index != -1; index = parents[0][index], --i)
+    {
+        path[i] = (queue[0][index] / stride) * width + queue[0][index] % stride;
+    }
+    for (int index = meet[1], i = depth[0] + 1; index != -1; index = parents[1][index], ++i)
+    {
+        path[i] = (queue[1][index] / stride) * width + queue[1][index] % stride;
+    }
+
+    printCellPath(maze, path, length, writer);
+    free(path);
+    return true;
+}
+
+// This function finds "cell" between the entries "first" and "last" of a queue of the bidirectional BFS.
+// It returns the index of the entry.
+int findQueuedCell(const int *queue, const int first, const int last, const int cell)
+{
+    for (int i = first; i < last; ++i)
+    {
+        if (queue[i] == cell)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// This function follows "distance" of a weighted search down from "cell" to the start.
+// The cells are saved into the end of "path" backwards, enter NULL to only count them.
+// It returns the number of cells on the path.
+int descendWeightedPath(const Maze *maze, const int *distance, int cell, int *path, const int length)
+{
+    int count = 0;
+
+    while (true)
+    {
+        if (path != NULL)
+        {
+            path[length - 1 - count] = cell;
+        }
+        count++;
+
+        if (distance[cell] == 0)
+        {
+            break;
+        }
+
+        // move to the first neighbour which the cheapest path came from.
+        const int previous = distance[cell] - getCost(maze, cell);
+        int neighbours[4];
+        const int neighbourCount = getNeighbours(maze, cell, neighbours);
+
+        for (int i = 0; i < neighbourCount; ++i)
+        {
+            if (distance[neighbours[i]] == previous)
+            {
+                cell = neighbours[i];
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+// This function uses Dial's algorithm to find the cheapest path on a map with terrain costs.
+// The costs are small integers, so a ring of "maxCost + 1" buckets replaces the heap.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathWeighted(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    const int cells = maze->width * maze->height;
+
+    // "distance" is -1 for the cells which have not been reached.
+    int *distance = malloc(sizeof(int) * cells);
+    BucketQueue queue;
+    if (distance == NULL || !initBucketQueue(&queue, maze->maxCost + 1))
+    {
+        free(distance);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    memset(distance, -1, sizeof(int) * cells);
+
+    const int start = y * maze->width + x;
+    int exitCell = -1;
+    uint64_t expanded = 0;
+    bool failed = !pushBucketQueue(&queue, 0, start);
+    distance[start] = 0;
+
+    while (!failed)
+    {
+        int key;
+        const int current = popBucketQueue(&queue, &key);
+        if (current == -1)
+        {
+            break;
+        }
+
+        // this cell has been reached by a cheaper path.
+        if (key != distance[current])
+        {
+            continue;
+        }
+        expanded++;
+
+        // the first exit popped is the cheapest one.
+        if (isExit(maze, current))
+        {
+            exitCell = current;
+            break;
+        }
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count && !failed; ++i)
+        {
+            const int next = neighbours[i];
+            const int nextDistance = distance[current] + getCost(maze, next);
+
+            if (distance[next] == -1 || nextDistance < distance[next])
+            {
+                distance[next] = nextDistance;
+                failed = !pushBucketQueue(&queue, nextDistance, next);
+            }
+        }
+    }
+
+    freeBucketQueue(&queue);
+    COUNT_EXPANDED(expanded);
+
+    if (failed)
+    {
+        free(distance);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    if (exitCell == -1)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        STAT_PHASE(PHASE_PATH);
+        const int length = descendWeightedPath(maze, distance, exitCell, NULL, 0);
+        int *path = malloc(sizeof(int) * length);
+        if (path == NULL)
+        {
+            free(distance);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        descendWeightedPath(maze, distance, exitCell, path, length);
+        printCellPath(maze, path, length, writer);
+        free(path);
+    }
+
+    free(distance);
+}
+
+// This function uses Dial's algorithm from all the exits to build the direction field.
+// Moving from a cell to "next" costs the cost of "next", so the search from the exits
+// adds the cost of the cell it comes from.
+// It returns false when it's unable to allocate memory.
+bool buildWeightedField(const Maze *maze, Field *field)
+{
+    const int width = maze->width;
+    const int cells = width * maze->height;
+
+    field->width = width;
+    field->height = maze->height;
+    field->mapping = NULL;
+    field->directions = malloc(sizeof(unsigned char) * (cells / 2 + 1));
+    int *distance = malloc(sizeof(int) * cells);
+    BucketQueue queue;
+    if (field->directions == NULL || distance == NULL || !initBucketQueue(&queue, maze->maxCost + 1))
+    {
+        free(field->directions);
+        free(distance);
+        return false;
+    }
+
+    // every cell starts as unreachable.
+    memset(field->directions, FIELD_NONE | (FIELD_NONE << 4), sizeof(unsigned char) * (cells / 2 + 1));
+    memset(distance, -1, sizeof(int) * cells);
+
+    uint64_t expanded = 0;
+    bool failed = false;
+    for (int i = 0; i < maze->exitCount && !failed; ++i)
+    {
+        setFieldDirection(field, maze->exits[i], FIELD_EXIT);
+        distance[maze->exits[i]] = 0;
+        failed = !pushBucketQueue(&queue, 0, maze->exits[i]);
+    }
+
+    while (!failed)
+    {
+        int key;
+        const int current = popBucketQueue(&queue, &key);
+        if (current == -1)
+        {
+            break;
+        }
+
+        // this cell has been reached by a cheaper path.
+        if (key != distance[current])
+        {
+            continue;
+        }
+        expanded++;
+
+        const int nextDistance = distance[current] + getCost(maze, current);
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count && !failed; ++i)
+        {
+            const int next = neighbours[i];
+            if (distance[next] != -1 && nextDistance >= distance[next])
+            {
+                continue;
+            }
+
+            // the move from "next" back to "current".
+            int direction;
+            if (next == current - width)
+            {
+                direction = DOWN;
+            }
+            else if (next == current + width)
+            {
+                direction = UP;
+            }
+            else if (next == current - 1)
+            {
+                direction = RIGHT;
+            }
+            else
+            {
+                direction = LEFT;
+            }
+
+            distance[next] = nextDistance;
+            setFieldDirection(field, next, direction);
+            failed = !pushBucketQueue(&queue, nextDistance, next);
+        }
+    }
+
+    freeBucketQueue(&queue);
+    free(distance);
+    COUNT_EXPANDED(expanded);
+
+    if (failed)
+    {
+        free(field->directions);
+        field->directions = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// This function creates an unnamed temporary file in "TMPDIR", or "/tmp" if it's not set.
+// It returns NULL when error occurs.
+FILE *createTempFile(void)
+{
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || *dir == '\0')
+    {
+        dir = "/tmp";
+    }
+
+    char *path = malloc(sizeof(char) * (strlen(dir) + 16));
+    if (path == NULL)
+    {
+        return NULL;
+    }
+    strcpy(path, dir);
+    strcat(path, "/dungeonXXXXXX");
+
+    int fd = mkstemp(path);
+    if (fd == -1)
+    {
+        free(path);
+        return NULL;
+    }
+
+    // the file is removed as soon as it's closed.
+    unlink(path);
+    free(path);
+
+    FILE *fPtr = fdopen(fd, "w+b");
+    if (fPtr == NULL)
+    {
+        close(fd);
+    }
+    return fPtr;
+}
+
+// This function checks whether the file "path" is a tiled map.
+// Files which can't be read are left to the normal loader to report.
+bool isTiledMap(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    // pread doesn't consume the data of a pipe, it just fails.
+    char magic[sizeof(TILED_MAGIC)];
+    bool tiled = pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+                 memcmp(magic, TILED_MAGIC, sizeof(magic)) == 0;
+
+    close(fd);
+    return tiled;
+}
+
+// This function converts a map into a tiled map, one tile at a time.
+// It calls "errorHandle" fucntion when error occurs.
+void convertTiled(const Options *options)
+{
+    Maze maze;
+    getMaze(options->path, &maze);
+
+    // a tiled map only has walls, floors and exits.
+    if (maze.weighted)
+    {
+        freeMaze(&maze);
+        errorHandle(2);
+    }
+
+    const uint64_t side = options->tileSize;
+    TiledHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC));
+    header.width = maze.width;
+    header.height = maze.height;
+    header.tilesX = (header.width + side - 1) / side;
+    header.tilesY = (header.height + side - 1) / side;
+    header.tileSize = side;
+
+    const size_t cellBytes = side * side / 4;
+    unsigned char *cells = malloc(sizeof(unsigned char) * cellBytes);
+    if (cells == NULL)
+    {
+        freeMaze(&maze);
+        errorHandle(5);
+    }
+
+    FILE *fPtr = fopen(options->outputPath, "wb");
+    if (fPtr == NULL)
+    {
+        free(cells);
+        freeMaze(&maze);
+        errorHandle(7);
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, fPtr) == 1;
+
+    for (uint64_t ty = 0; ty < header.tilesY && written; ++ty)
+    {
+        for (uint64_t tx = 0; tx < header.tilesX && written; ++tx)
+        {
+            // the cells out of the map stay walls.
+            memset(cells, 0, sizeof(unsigned char) * cellBytes);
+
+            for (uint64_t cy = 0; cy < side && ty * side + cy < header.height; ++cy)
+            {
+                const char *line = maze.cells + (ty * side + cy) * maze.stride + tx * side;
+
+                for (uint64_t cx = 0; cx < side && tx * side + cx < header.width; ++cx)
+                {
+                    const uint64_t cell = cy * side + cx;
+                    int value = TILED_OPEN;
+                    if (line[cx] == '#')
+                    {
+                        value = TILED_WALL;
+                    }
+                    else if (line[cx] == 'x')
+                    {
+                        value = TILED_EXIT;
+                    }
+
+                    cells[cell / 4] |= value << ((cell % 4) * 2);
+                }
+            }
+
+            written = fwrite(cells, sizeof(unsigned char), cellBytes, fPtr) == cellBytes;
+        }
+    }
+
+    free(cells);
+    freeMaze(&maze);
+
+    if (fclose(fPtr) != 0 || !written)
+    {
+        errorHandle(7);
+    }
+}
+
+// This function writes the state of a tile back to the state file, if it has changed.
+// It returns false when error occurs.
+bool flushTile(TileCache *cache, Tile *tile)
+{
+    if (!tile->dirty)
+    {
+        return true;
+    }
+
+    const off_t offset = (off_t)(tile->id * cache->stateBytes);
+    if (pwrite(fileno(cache->stateFile), tile->state, cache->stateBytes, offset) != (ssize_t)cache->stateBytes)
+    {
+        return false;
+    }
+
+    tile->dirty = false;
+    return true;
+}
+
+// This function returns the tile "id", reading it from disk if it's not in memory.
+// It returns NULL when error occurs, "errno" tells the reason.
+Tile *getTile(TileCache *cache, const uint64_t id)
+{
+    cache->clock++;
+
+    // the empty slots are never used, so they are evicted first.
+    Tile *victim = &cache->tiles[0];
+    for (int i = 0; i < cache->capacity; ++i)
+    {
+        if (cache->tiles[i].id == id)
+        {
+            cache->tiles[i].lastUsed = cache->clock;
+            return &cache->tiles[i];
+        }
+        else if (cache->tiles[i].lastUsed < victim->lastUsed)
+        {
+            victim = &cache->tiles[i];
+        }
+    }
+
+    if (victim->id != UINT64_MAX && !flushTile(cache, victim))
+    {
+        return NULL;
+    }
+    victim->id = UINT64_MAX;
+
+    if (victim->cells == NULL)
+    {
+        victim->cells = malloc(sizeof(unsigned char) * cache->cellBytes);
+        victim->state = malloc(sizeof(unsigned char) * cache->stateBytes);
+        if (victim->cells == NULL || victim->state == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    const off_t cellOffset = (off_t)(sizeof(TiledHeader) + id * cache->cellBytes);
+    const off_t stateOffset = (off_t)(id * cache->stateBytes);
+    if (pread(cache->mapFd, victim->cells, cache->cellBytes, cellOffset) != (ssize_t)cache->cellBytes ||
+        pread(fileno(cache->stateFile), victim->state, cache->stateBytes, stateOffset) != (ssize_t)cache->stateBytes)
+    {
+        errno = (errno == 0) ? EIO : errno;
+        return NULL;
+    }
+
+    victim->id = id;
+    victim->dirty = false;
+    victim->lastUsed = cache->clock;
+    return victim;
+}
+
+// This function returns the value of "cell" in a tile, one of "TILED_WALL", "TILED_OPEN" and "TILED_EXIT".
+int getTiledCell(const Tile *tile, const uint32_t cell)
+{
+    return (tile->cells[cell / 4] >> ((cell % 4) * 2)) & 3;
+}
+
+// This function returns the state of "cell" in a tile.
+int getTiledState(const Tile *tile, const uint32_t cell)
+{
+    return (tile->state[cell / 2] >> ((cell % 2) * 4)) & 0x0F;
+}
+
+// This function saves the state of "cell" in a tile.
+void setTiledState(Tile *tile, const uint32_t cell, const int state)
+{
+    unsigned char *pair = &tile->state[cell / 2];
+
+    if (cell % 2 == 0)
+    {
+        *pair = (*pair & 0xF0) | state;
+    }
+    else
+    {
+        *pair = (*pair & 0x0F) | (state << 4);
+    }
+
+    tile->dirty = true;
+}
+
+// This function moves from a cell of a tile in "dir", the result may be in another tile.
+// It returns false if the move leaves the tiled map.
+bool moveTiled(const TileCache *cache, uint64_t *tileId, uint32_t *cell, const int dir)
+{
+    const uint32_t side = cache->header.tileSize;
+    const uint32_t cx = *cell % side;
+    const uint32_t cy = *cell / side;
+    const uint64_t tx = *tileId % cache->header.tilesX;
+    const uint64_t ty = *tileId / cache->header.tilesX;
+
+    switch (dir)
+    {
+        case UP:
+            if (cy > 0)
+            {
+                *cell -= side;
+                return true;
+            }
+            else if (ty > 0)
+            {
+                *tileId -= cache->header.tilesX;
+                *cell = (side - 1) * side + cx;
+                return true;
+            }
+            return false;
+
+        case DOWN:
+            if (cy < side - 1)
+            {
+                *cell += side;
+                return true;
+            }
+            else if (ty < cache->header.tilesY - 1)
+            {
+                *tileId += cache->header.tilesX;
+                *cell = cx;
+                return true;
+            }
+            return false;
+
+        case LEFT:
+            if (cx > 0)
+            {
+                *cell -= 1;
+                return true;
+            }
+            else if (tx > 0)
+            {
+                *tileId -= 1;
+                *cell = cy * side + side - 1;
+                return true;
+            }
+            return false;
+
+        default:
+            if (cx < side - 1)
+            {
+                *cell += 1;
+                return true;
+            }
+            else if (tx < cache->header.tilesX - 1)
+            {
+                *tileId += 1;
+                *cell = cy * side;
+                return true;
+            }
+            return false;
+    }
+}
+
+// This function sorts the records by tile, then by cell.
+int compareRecords(const void *a, const void *b)
+{
+    const FrontierRecord *first = a;
+    const FrontierRecord *second = b;
+
+    if (first->tile != second->tile)
+    {
+        return (first->tile < second->tile) ? -1 : 1;
+    }
+    if (first->cell != second->cell)
+    {
+        return (first->cell < second->cell) ? -1 : 1;
+    }
+    return 0;
+}
+
+// This function sorts the buffer of a frontier and writes it to a new spill file.
+// It returns false when error occurs.
+bool spillFrontier(Frontier *frontier)
+{
+    qsort(frontier->buffer, frontier->size, sizeof(FrontierRecord), compareRecords);
+
+    // malloc more memory when reach the limit
+    if (frontier->runCount == frontier->runLimit)
+    {
+        int limit = frontier->runLimit == 0 ? EXIT_LIST_SIZE : frontier->runLimit * 2;
+        FILE **runs = realloc(frontier->runs, sizeof(FILE *) * limit);
+        if (runs == NULL)
+        {
+            return false;
+        }
+
+        frontier->runs = runs;
+        frontier->runLimit = limit;
+    }
+
+    FILE *run = createTempFile();
+    if (run == NULL)
+    {
+        return false;
+    }
+    frontier->runs[frontier->runCount++] = run;
+
+    if (fwrite(frontier->buffer, sizeof(FrontierRecord), frontier->size, run) != frontier->size ||
+        fflush(run) != 0)
+    {
+        return false;
+    }
+
+    rewind(run);
+    frontier->size = 0;
+    return true;
+}
+
+// This function adds a record to the frontier, the buffer is spilled when it's full.
+// It returns false when error occurs.
+bool pushFrontier(Frontier *frontier, const FrontierRecord *record)
+{
+    if (frontier->size == FRONTIER_BUFFER_SIZE && !spillFrontier(frontier))
+    {
+        return false;
+    }
+
+    frontier->buffer[frontier->size++] = *record;
+    return true;
+}
+
+// This function removes all the records of a frontier and closes its spill files.
+void clearFrontier(Frontier *frontier)
+{
+    for (int i = 0; i < frontier->runCount; ++i)
+    {
+        fclose(frontier->runs[i]);
+    }
+
+    frontier->runCount = 0;
+    frontier->size = 0;
+}
+
+// This function prepares to read a frontier in order.
+// The buffer must be sorted already.
+// It returns false when error occurs.
+bool openFrontierReader(FrontierReader *reader, Frontier *frontier)
+{
+    reader->frontier = frontier;
+    reader->bufferIndex = 0;
+    reader->heads = malloc(sizeof(FrontierRecord) * (frontier->runCount + 1));
+    reader->alive = malloc(sizeof(bool) * (frontier->runCount + 1));
+    if (reader->heads == NULL || reader->alive == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < frontier->runCount; ++i)
+    {
+        reader->alive[i] = fread(&reader->heads[i], sizeof(FrontierRecord), 1, frontier->runs[i]) == 1;
+    }
+
+    return true;
+}
+
+// This function reads the next record of a frontier, merging the spill files and the buffer.
+// It returns false when there are no more records.
+bool readFrontier(FrontierReader *reader, FrontierRecord *record)
+{
+    const Frontier *frontier = reader->frontier;
+    const FrontierRecord *best = NULL;
+    int bestRun = -1;
+
+    for (int i = 0; i < frontier->runCount; ++i)
+    {
+        if (reader->alive[i] && (best == NULL || compareRecords(&reader->heads[i], best) < 0))
+        {
+            best = &reader->heads[i];
+            bestRun = i;
+        }
+    }
+
+    if (reader->bufferIndex < frontier->size &&
+        (best == NULL || compareRecords(&frontier->buffer[reader->bufferIndex], best) < 0))
+    {
+        *record = frontier->buffer[reader->bufferIndex++];
+        return true;
+    }
+    else if (best == NULL)
+    {
+        return false;
+    }
+
+    *record = *best;
+    reader->alive[bestRun] = fread(&reader->heads[bestRun], sizeof(FrontierRecord), 1,
+                                   frontier->runs[bestRun]) == 1;
+    return true;
+}
+
+// This function frees the memory used by a frontier reader.
+void closeFrontierReader(FrontierReader *reader)
+{
+    free(reader->heads);
+    free(reader->alive);
+    reader->heads = NULL;
+    reader->alive = NULL;
+}
+
+// This function frees everything used by the out-of-core solver.
+void freeTiledSearch(TiledSearch *search)
+{
+    if (search->cache.mapFd != -1)
+    {
+        close(search->cache.mapFd);
+    }
+    if (search->cache.stateFile != NULL)
+    {
+        fclose(search->cache.stateFile);
+    }
+    if (search->cache.tiles != NULL)
+    {
+        for (int i = 0; i < search->cache.capacity; ++i)
+        {
+            free(search->cache.tiles[i].cells);
+            free(search->cache.tiles[i].state);
+        }
+        free(search->cache.tiles);
+    }
+
+    clearFrontier(&search->current);
+    clearFrontier(&search->next);
+    free(search->current.runs);
+    free(search->next.runs);
+    free(search->current.buffer);
+    free(search->next.buffer);
+    closeFrontierReader(&search->reader);
+
+    if (search->pathFile != NULL)
+    {
+        fclose(search->pathFile);
+    }
+}
+
+// This function frees everything used by the out-of-core solver and exits the program.
+void failTiledSearch(TiledSearch *search, const int errorCode)
+{
+    // keep "errno" for the error message.
+    int error = errno;
+    freeTiledSearch(search);
+    errno = error;
+
+    errorHandle(errorCode);
+}
+
+// This function adds the neighbours of a cell to the next frontier.
+// The neighbours in the same tile are checked now, the others when their tile is read.
+// It returns false when error occurs.
+bool expandTiledCell(TiledSearch *search, const Tile *tile, const uint32_t cell)
+{
+    for (int dir = UP; dir <= RIGHT; ++dir)
+    {
+        FrontierRecord record;
+        record.tile = tile->id;
+        record.cell = cell;
+        if (!moveTiled(&search->cache, &record.tile, &record.cell, dir))
+        {
+            continue;
+        }
+
+        if (record.tile == tile->id &&
+            (getTiledCell(tile, record.cell) == TILED_WALL || (getTiledState(tile, record.cell) & STATE_VISITED)))
+        {
+            continue;
+        }
+
+        // the parent is in the opposite direction.
+        record.parent = dir ^ 1;
+        if (!pushFrontier(&search->next, &record))
+        {
+            return false;
+        }
+        STAT_ADD(enqueued, 1);
+    }
+
+    return true;
+}
+
+// This function prints the path from the start to the exit in a tiled map.
+// The path is written to a temporary file from the exit, then printed backwards.
+// It calls "errorHandle" fucntion when error occurs.
+void printTiledPath(TiledSearch *search, uint64_t tileId, uint32_t cell, PathWriter *writer)
+{
+    const uint64_t side = search->cache.header.tileSize;
+    const uint64_t tilesX = search->cache.header.tilesX;
+
+    search->pathFile = createTempFile();
+    if (search->pathFile == NULL)
+    {
+        failTiledSearch(search, 3);
+    }
+
+    uint64_t length = 0;
+    while (true)
+    {
+        const Tile *tile = getTile(&search->cache, tileId);
+        if (tile == NULL)
+        {
+            failTiledSearch(search, errno == ENOMEM ? 5 : 3);
+        }
+
+        uint64_t point[2];
+        point[0] = (tileId % tilesX) * side + cell % side;
+        point[1] = (tileId / tilesX) * side + cell / side;
+        if (fwrite(point, sizeof(point), 1, search->pathFile) != 1)
+        {
+            failTiledSearch(search, 3);
+        }
+        length++;
+
+        const int state = getTiledState(tile, cell);
+        if (state & STATE_ROOT)
+        {
+            break;
+        }
+        moveTiled(&search->cache, &tileId, &cell, state & 3);
+    }
+
+    // print the points from the end of the file.
+    uint64_t points[STREAM_CHUNK_SIZE / 16][2];
+    const uint64_t chunk = STREAM_CHUNK_SIZE / 16;
+    uint64_t position = length;
+
+    while (position > 0)
+    {
+        const uint64_t count = (position < chunk) ? position : chunk;
+        position -= count;
+
+        if (fseeko(search->pathFile, (off_t)(position * sizeof(points[0])), SEEK_SET) != 0 ||
+            fread(points, sizeof(points[0]), count, search->pathFile) != count)
+        {
+            failTiledSearch(search, 3);
+        }
+
+        for (uint64_t i = count; i > 0; --i)
+        {
+            writePathCell(writer, points[i - 1][0], points[i - 1][1]);
+        }
+    }
+    endPath(writer);
+}
+
+// This function uses an out-of-core BFS to solve a tiled map.
+// Only "--tile-cache" tiles are in memory, the state of the other tiles is kept in a temporary file.
+// Each level is a frontier sorted by tile, so every tile is read at most once per level.
+// It calls "errorHandle" fucntion when error occurs.
+void solveTiled(const Options *options)
+{
+    const double loadStart = getTime();
+    TiledSearch search;
+    memset(&search, 0, sizeof(search));
+    search.cache.mapFd = -1;
+
+    search.cache.mapFd = open(options->path, O_RDONLY);
+    if (search.cache.mapFd == -1)
+    {
+        errorHandle(3);
+    }
+
+    // check the header and the size of the tiled map.
+    TiledHeader *header = &search.cache.header;
+    struct stat info;
+    if (fstat(search.cache.mapFd, &info) == -1)
+    {
+        failTiledSearch(&search, 3);
+    }
+
+    if (pread(search.cache.mapFd, header, sizeof(TiledHeader), 0) != sizeof(TiledHeader) ||
+        header->tileSize < 8 || header->tileSize > MAX_TILE_SIZE || header->tileSize % 8 != 0 ||
+        header->tilesX != (header->width + header->tileSize - 1) / header->tileSize ||
+        header->tilesY != (header->height + header->tileSize - 1) / header->tileSize ||
+        header->tilesX == 0 || header->tilesY == 0 || header->tilesX > UINT64_MAX / header->tilesY)
+    {
+        failTiledSearch(&search, 2);
+    }
+
+    const uint64_t side = header->tileSize;
+    const uint64_t tileCount = header->tilesX * header->tilesY;
+    search.cache.cellBytes = side * side / 4;
+    search.cache.stateBytes = side * side / 2;
+    if ((uint64_t)info.st_size != sizeof(TiledHeader) + tileCount * search.cache.cellBytes)
+    {
+        failTiledSearch(&search, 2);
+    }
+
+    if ((uint64_t)options->x >= header->width || (uint64_t)options->y >= header->height)
+    {
+        failTiledSearch(&search, 4);
+    }
+
+    // the state file is sparse, the tiles which are never written read as zeros.
+    search.cache.capacity = options->tileCacheSize;
+    search.cache.tiles = calloc(search.cache.capacity, sizeof(Tile));
+    search.current.buffer = malloc(sizeof(FrontierRecord) * FRONTIER_BUFFER_SIZE);
+    search.next.buffer = malloc(sizeof(FrontierRecord) * FRONTIER_BUFFER_SIZE);
+    if (search.cache.tiles == NULL || search.current.buffer == NULL || search.next.buffer == NULL)
+    {
+        failTiledSearch(&search, 5);
+    }
+    for (int i = 0; i < search.cache.capacity; ++i)
+    {
+        search.cache.tiles[i].id = UINT64_MAX;
+    }
+
+    search.cache.stateFile = createTempFile();
+    if (search.cache.stateFile == NULL ||
+        ftruncate(fileno(search.cache.stateFile), (off_t)(tileCount * search.cache.stateBytes)) != 0)
+    {
+        failTiledSearch(&search, 3);
+    }
+
+    // the tiles are read during the search, so the load time only covers the header and the state file.
+    const double solveStart = getTime();
+    const uint64_t x = options->x;
+    const uint64_t y = options->y;
+    FrontierRecord start;
+    start.tile = (y / side) * header->tilesX + x / side;
+    start.cell = (y % side) * side + x % side;
+    start.parent = STATE_ROOT;
+
+    const Tile *startTile = getTile(&search.cache, start.tile);
+    if (startTile == NULL)
+    {
+        failTiledSearch(&search, errno == ENOMEM ? 5 : 3);
+    }
+    else if (getTiledCell(startTile, start.cell) == TILED_WALL)
+    {
+        failTiledSearch(&search, 4);
+    }
+    else if (getTiledCell(startTile, start.cell) == TILED_EXIT)
+    {
+        printf("%llu,%llu\n", (unsigned long long)x, (unsigned long long)y);
+        if (options->bench)
+        {
+            printBench("tiled", header->width, header->height, solveStart - loadStart, getTime() - solveStart);
+        }
+        freeTiledSearch(&search);
+        return;
+    }
+
+    search.next.buffer[search.next.size++] = start;
+
+    bool found = false;
+    uint64_t expanded = 0;
+    FrontierRecord record;
+
+    while (!found && (search.next.size > 0 || search.next.runCount > 0))
+    {
+        // the next level becomes the current level.
+        qsort(search.next.buffer, search.next.size, sizeof(FrontierRecord), compareRecords);
+        Frontier tmp = search.current;
+        search.current = search.next;
+        search.next = tmp;
+
+        if (!openFrontierReader(&search.reader, &search.current))
+        {
+            failTiledSearch(&search, 5);
+        }
+
+        while (readFrontier(&search.reader, &record))
+        {
+            Tile *tile = getTile(&search.cache, record.tile);
+            if (tile == NULL)
+            {
+                failTiledSearch(&search, errno == ENOMEM ? 5 : 3);
+            }
+
+            const int content = getTiledCell(tile, record.cell);
+            if (content == TILED_WALL || (getTiledState(tile, record.cell) & STATE_VISITED))
+            {
+                continue;
+            }
+
+            setTiledState(tile, record.cell, STATE_VISITED | record.parent);
+
+            if (content == TILED_EXIT)
+            {
+                found = true;
+                break;
+            }
+
+            if (!expandTiledCell(&search, tile, record.cell))
+            {
+                failTiledSearch(&search, errno == ENOMEM ? 5 : 3);
+            }
+            expanded++;
+        }
+
+        for (int i = 0; i < search.current.runCount; ++i)
+        {
+            if (ferror(search.current.runs[i]))
+            {
+                failTiledSearch(&search, 3);
+            }
+        }
+
+        closeFrontierReader(&search.reader);
+        clearFrontier(&search.current);
+    }
+    COUNT_EXPANDED(expanded);
+
+    if (!found)
+    {
+        printf("%llu,%llu\n", (unsigned long long)x, (unsigned long long)y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        char outputBuffer[OUTPUT_BUFFER_SIZE];
+        PathWriter writer;
+        initPathWriter(&writer, outputBuffer, OUTPUT_BUFFER_SIZE, options->compact, stdout);
+        printTiledPath(&search, record.tile, record.cell, &writer);
+    }
+
+    if (options->bench)
+    {
+        printBench("tiled", header->width, header->height, solveStart - loadStart, getTime() - solveStart);
+    }
+    freeTiledSearch(&search);
+}
+
+// This function follows "distance" down from "cell" to the cell at distance 0.
+// The cells are saved into "path" with the given step, so the path can be saved in both directions.
+// It returns the number of cells saved.
+int descendPath(const Maze *maze, const int *distance, int cell, int *path, const int step)
+{
+    int count = 0;
+
+    while (true)
+    {
+        *path = cell;
+        path += step;
+        count++;
+
+        if (distance[cell] == 0)
+        {
+            break;
+        }
+
+        // move to the first neighbour which is one step closer.
+        int neighbours[4];
+        const int neighbourCount = getNeighbours(maze, cell, neighbours);
+
+        for (int i = 0; i < neighbourCount; ++i)
+        {
+            if (distance[neighbours[i]] == distance[cell] - 1)
+            {
+                cell = neighbours[i];
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+// This function prints a path saved as cell numbers.
+void printCellPath(const Maze *maze, const int *path, const int length, PathWriter *writer)
+{
+    STAT_PHASE(PHASE_OUTPUT);
+    STAT_ADD(pathLength, length);
+
+    for (int i = 0; i < length; ++i)
+    {
+        writePathCell(writer, path[i] % maze->width, path[i] / maze->width);
+    }
+    endPath(writer);
+}
+
+// This function creates an empty path writer on "buffer".
+// The text is written to "output" when the buffer is full and after each path.
+// Enter NULL to keep the text, then "buffer" must be allocated by malloc, so it can grow.
+void initPathWriter(PathWriter *writer, char *buffer, const size_t limit, const bool compact, FILE *output)
+{
+    writer->buffer = buffer;
+    writer->size = 0;
+    writer->limit = limit;
+    writer->output = output;
+    writer->failed = false;
+    writer->compact = compact;
+    writer->count = 0;
+    writer->move = 0;
+    writer->run = 0;
+    writer->runCount = 0;
+}
+
+// This function makes room for "size" more bytes in the buffer.
+// It returns false when it's unable to allocate memory, and "failed" is set.
+bool reservePathWriter(PathWriter *writer, const size_t size)
+{
+    if (writer->size + size <= writer->limit)
+    {
+        return true;
+    }
+
+    if (writer->output != NULL)
+    {
+        flushPathWriter(writer);
+        return true;
+    }
+
+    // malloc more memory when reach the limit
+    size_t limit = writer->limit * 2;
+    while (limit < writer->size + size)
+    {
+        limit *= 2;
+    }
+
+    char *buffer = realloc(writer->buffer, limit);
+    if (buffer == NULL)
+    {
+        writer->failed = true;
+        return false;
+    }
+
+    writer->buffer = buffer;
+    writer->limit = limit;
+    return true;
+}
+
+// This function writes the buffer to the output.
+// It's written through stdio, so it stays in order with the other messages.
+void flushPathWriter(PathWriter *writer)
+{
+    if (writer->output != NULL)
+    {
+        fwrite(writer->buffer, sizeof(char), writer->size, writer->output);
+        writer->size = 0;
+    }
+}
+
+// This function appends a message, such as "No escape possible.\n".
+void writeText(PathWriter *writer, const char *text)
+{
+    const size_t length = strlen(text);
+
+    if (reservePathWriter(writer, length))
+    {
+        memcpy(writer->buffer + writer->size, text, length);
+        writer->size += length;
+    }
+}
+
+// This function appends "value" to the buffer in decimal, without "printf".
+void writeNumber(PathWriter *writer, uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+
+    // the digits are found from the last one.
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+    {
+        writer->buffer[writer->size++] = digits[--count];
+    }
+}
+
+// This function appends the current run of moves, e.g. "R12", in compact mode.
+void writeRun(PathWriter *writer)
+{
+    if (writer->run == 0)
+    {
+        return;
+    }
+
+    if (writer->runCount > 0)
+    {
+        writer->buffer[writer->size++] = ' ';
+    }
+    writer->buffer[writer->size++] = writer->move;
+    writeNumber(writer, writer->run);
+    writer->runCount++;
+}
+
+// This function adds the next cell of the path.
+// Each cell must be next to the last one.
+void writePathCell(PathWriter *writer, const uint64_t x, const uint64_t y)
+{
+    if (!reservePathWriter(writer, OUTPUT_ITEM_SIZE))
+    {
+        return;
+    }
+
+    if (!writer->compact || writer->count == 0)
+    {
+        writeNumber(writer, x);
+        writer->buffer[writer->size++] = ',';
+        writeNumber(writer, y);
+        writer->buffer[writer->size++] = '\n';
+    }
+    else
+    {
+        // the move from the last cell, a new run starts when it changes.
+        const char move = (y < writer->lastY) ? 'U' : (y > writer->lastY) ? 'D' : (x < writer->lastX) ? 'L' : 'R';
+        if (move != writer->move)
+        {
+            writeRun(writer);
+            writer->move = move;
+            writer->run = 0;
+        }
+        writer->run++;
+    }
+
+    writer->count++;
+    writer->lastX = x;
+    writer->lastY = y;
+}
+
+// This function finishes the path and writes it out if there's an output.
+// The writer can be used for the next path.
+void endPath(PathWriter *writer)
+{
+    if (writer->compact && reservePathWriter(writer, OUTPUT_ITEM_SIZE))
+    {
+        writeRun(writer);
+        if (writer->runCount > 0)
+        {
+            writer->buffer[writer->size++] = '\n';
+        }
+    }
+
+    flushPathWriter(writer);
+    writer->count = 0;
+    writer->move = 0;
+    writer->run = 0;
+    writer->runCount = 0;
+}
+
+// This function creates a bucket queue with "count" buckets.
+// It returns false when it's unable to allocate memory.
+bool initBucketQueue(BucketQueue *queue, const int count)
+{
+    queue->buckets = calloc(count, sizeof(Bucket));
+    if (queue->buckets == NULL)
+    {
+        return false;
+    }
+
+    queue->count = count;
+    queue->current = 0;
+    queue->size = 0;
+    return true;
+}
+
+// This function free all the memory allcated for the bucket queue.
+void freeBucketQueue(BucketQueue *queue)
+{
+    for (int i = 0; i < queue->count; ++i)
+    {
+        free(queue->buckets[i].cells);
+    }
+
+    free(queue->buckets);
+    queue->buckets = NULL;
+    queue->count = 0;
+}
+
+// This function adds "cell" with "key" into the queue.
+// The key must not be less than the key of the last popped cell.
+// It returns false when it's unable to allocate memory.
+bool pushBucketQueue(BucketQueue *queue, const int key, const int cell)
+{
+    if (queue->size == 0 || key < queue->current)
+    {
+        queue->current = key;
+    }
+
+    Bucket *bucket = &queue->buckets[key % queue->count];
+
+    // malloc more memory when reach the limit
+    if (bucket->size == bucket->limit)
+    {
+        int limit = bucket->limit == 0 ? BUCKET_SIZE : bucket->limit * 2;
+        int *cells = realloc(bucket->cells, sizeof(int) * limit);
+        if (cells == NULL)
+        {
+            return false;
+        }
+
+        bucket->cells = cells;
+        bucket->limit = limit;
+    }
+
+    bucket->cells[bucket->size++] = cell;
+    queue->size++;
+    STAT_ADD(enqueued, 1);
+    STAT_MAX(maxFrontier, queue->size);
+    return true;
+}
+
+// This function removes a cell with the smallest key from the queue.
+// The key is saved into "key".
+// It returns -1 if the queue is empty.
+int popBucketQueue(BucketQueue *queue, int *key)
+{
+    if (queue->size == 0)
+    {
+        return -1;
+    }
+
+    // skip the empty buckets.
+    Bucket *bucket = &queue->buckets[queue->current % queue->count];
+    while (bucket->size == 0)
+    {
+        queue->current++;
+        bucket = &queue->buckets[queue->current % queue->count];
+    }
+
+    // the last cell is popped first, it's usually the deepest one.
+    queue->size--;
+    *key = queue->current;
+    return bucket->cells[--bucket->size];
+}
+
+// This function returns the Manhattan distance from "cell" to the box around all exits.
+// It's the distance to the exit when there is only one exit,
+// and it never overestimates the distance to the nearest exit.
+int getHeuristic(const Maze *maze, const int cell)
+{
+    const int x = cell % maze->width;
+    const int y = cell / maze->width;
+    int dx = 0;
+    int dy = 0;
+
+    if (x < maze->exitMinX)
+    {
+        dx = maze->exitMinX - x;
+    }
+    else if (x > maze->exitMaxX)
+    {
+        dx = x - maze->exitMaxX;
+    }
+
+    if (y < maze->exitMinY)
+    {
+        dy = maze->exitMinY - y;
+    }
+    else if (y > maze->exitMaxY)
+    {
+        dy = y - maze->exitMaxY;
+    }
+
+    return dx + dy;
+}
+
+// This function uses A* to find the shortest path.
+// Every move costs 1 and changes the heuristic by -1, 0 (inside the box of the exits) or +1,
+// so the key of a new cell is the current key plus 0, 1 or 2, and three buckets are enough.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathAStar(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    const int cells = maze->width * maze->height;
+
+    // "distance" is -1 for the cells which have not been reached.
+    int *distance = malloc(sizeof(int) * cells);
+    BucketQueue queue;
+    if (distance == NULL || !initBucketQueue(&queue, 3))
+    {
+        free(distance);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    memset(distance, -1, sizeof(int) * cells);
+
+    const int start = y * maze->width + x;
+    int exitCell = -1;
+    bool found = false;
+    uint64_t expanded = 0;
+    bool failed = !pushBucketQueue(&queue, getHeuristic(maze, start), start);
+    distance[start] = 0;
+
+    while (!failed)
+    {
+        int key;
+        const int current = popBucketQueue(&queue, &key);
+        if (current == -1)
+        {
+            break;
+        }
+
+        // this cell has been reached by a shorter path.
+        if (key != distance[current] + getHeuristic(maze, current))
+        {
+            continue;
+        }
+        expanded++;
+
+        // the first exit popped is the nearest one.
+        if (isExit(maze, current))
+        {
+            exitCell = current;
+            found = true;
+            break;
+        }
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count && !failed; ++i)
+        {
+            const int next = neighbours[i];
+
+            if (distance[next] == -1 || distance[current] + 1 < distance[next])
+            {
+                distance[next] = distance[current] + 1;
+                failed = !pushBucketQueue(&queue, distance[next] + getHeuristic(maze, next), next);
+            }
+        }
+    }
+
+    freeBucketQueue(&queue);
+    COUNT_EXPANDED(expanded);
+
+    if (failed)
+    {
+        free(distance);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    if (!found)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        STAT_PHASE(PHASE_PATH);
+        int *path = malloc(sizeof(int) * (distance[exitCell] + 1));
+        if (path == NULL)
+        {
+            free(distance);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        // the distances of the cells on the way back are exact.
+        descendPath(maze, distance, exitCell, path + distance[exitCell], -1);
+        printCellPath(maze, path, distance[exitCell] + 1, writer);
+        free(path);
+    }
+
+    free(distance);
+}
+
+// This function checks whether the location (x, y) is in the maze and is not a wall.
+bool isOpen(const Maze *maze, const int x, const int y)
+{
+    if (x < 0 || x >= maze->width || y < 0 || y >= maze->height)
+    {
+        return false;
+    }
+
+    return *(maze->cells + y * maze->stride + x) != '#';
+}
+
+// This function checks whether a horizontal move into (x, y) has a forced neighbour.
+// A vertical turn is only needed when it's impossible to turn one cell earlier.
+bool isForced(const Maze *maze, const int x, const int y, const int dir)
+{
+    const int previousX = (dir == LEFT) ? x + 1 : x - 1;
+
+    return (isOpen(maze, x, y - 1) && !isOpen(maze, previousX, y - 1)) ||
+           (isOpen(maze, x, y + 1) && !isOpen(maze, previousX, y + 1));
+}
+
+// This function moves from (x, y) in a horizontal direction until it reaches a jump point.
+// It returns the cell of the jump point, or -1 if it reaches a wall.
+int jumpHorizontal(const Maze *maze, int x, int y, const int dir)
+{
+    const int step = (dir == LEFT) ? -1 : 1;
+
+    while (true)
+    {
+        x += step;
+
+        if (!isOpen(maze, x, y))
+        {
+            return -1;
+        }
+        else if (*(maze->cells + y * maze->stride + x) == 'x' || isForced(maze, x, y, dir))
+        {
+            return y * maze->width + x;
+        }
+    }
+}
+
+// This function moves from (x, y) in "dir" until it reaches a jump point.
+// A vertical move may turn at any cell, so it stops where a horizontal jump succeeds.
+// It returns the cell of the jump point, or -1 if it reaches a wall.
+int jump(const Maze *maze, int x, int y, const int dir)
+{
+    if (dir == LEFT || dir == RIGHT)
+    {
+        return jumpHorizontal(maze, x, y, dir);
+    }
+
+    const int step = (dir == UP) ? -1 : 1;
+
+    while (true)
+    {
+        y += step;
+
+        if (!isOpen(maze, x, y))
+        {
+            return -1;
+        }
+        else if (*(maze->cells + y * maze->stride + x) == 'x' ||
+                 jumpHorizontal(maze, x, y, LEFT) != -1 ||
+                 jumpHorizontal(maze, x, y, RIGHT) != -1)
+        {
+            return y * maze->width + x;
+        }
+    }
+}
+
+// This function uses Jump Point Search on top of A* to find the shortest path.
+// Only the paths which turn from horizontal to vertical at forced neighbours are searched,
+// every shortest path can be changed into one of them.
+// A node in the queue is "cell * 4 + direction of the last move".
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathJPS(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    const int cells = maze->width * maze->height;
+    const int maxSide = maze->width > maze->height ? maze->width : maze->height;
+
+    // "distance" is -1 for the cells which have not been reached.
+    // "directions" records which directions have been queued with the current distance.
+    int *distance = malloc(sizeof(int) * cells);
+    int *parent = malloc(sizeof(int) * cells);
+    unsigned char *directions = calloc(cells, sizeof(unsigned char));
+    BucketQueue queue;
+
+    // one jump changes the key by at most twice the length of the jump.
+    if (distance == NULL || parent == NULL || directions == NULL || !initBucketQueue(&queue, 2 * maxSide + 1))
+    {
+        free(distance);
+        free(parent);
+        free(directions);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    memset(distance, -1, sizeof(int) * cells);
+
+    const int dx[4] = {0, 0, -1, 1};
+    const int start = y * maze->width + x;
+    int exitCell = -1;
+    bool found = false;
+    bool failed = false;
+    uint64_t expanded = 0;
+    distance[start] = 0;
+    parent[start] = -1;
+
+    // the start is expanded in all directions.
+    int node = -1;
+    int key = getHeuristic(maze, start);
+
+    while (!failed)
+    {
+        int current = start;
+        int successors[4] = {UP, DOWN, LEFT, RIGHT};
+        int count = 4;
+
+        if (node != -1)
+        {
+            current = node / 4;
+            const int dir = node % 4;
+
+            // this cell has been reached by a shorter path.
+            if (key != distance[current] + getHeuristic(maze, current))
+            {
+                node = popBucketQueue(&queue, &key);
+                if (node == -1)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (isExit(maze, current))
+            {
+                exitCell = current;
+                found = true;
+                break;
+            }
+
+            // keep moving, vertical moves may also turn, horizontal moves turn only when forced.
+            const int currentX = current % maze->width;
+            const int currentY = current / maze->width;
+            const int previousX = currentX - dx[dir];
+            count = 0;
+            successors[count++] = dir;
+
+            if (dir == UP || dir == DOWN)
+            {
+                successors[count++] = LEFT;
+                successors[count++] = RIGHT;
+            }
+            else
+            {
+                if (isOpen(maze, currentX, currentY - 1) && !isOpen(maze, previousX, currentY - 1))
+                {
+                    successors[count++] = UP;
+                }
+                if (isOpen(maze, currentX, currentY + 1) && !isOpen(maze, previousX, currentY + 1))
+                {
+                    successors[count++] = DOWN;
+                }
+            }
+        }
+
+        expanded++;
+        for (int i = 0; i < count && !failed; ++i)
+        {
+            const int dir = successors[i];
+            const int next = jump(maze, current % maze->width, current / maze->width, dir);
+            if (next == -1)
+            {
+                continue;
+            }
+
+            const int length = abs(next % maze->width - current % maze->width) +
+                               abs(next / maze->width - current / maze->width);
+            const int nextDistance = distance[current] + length;
+
+            if (distance[next] == -1 || nextDistance < distance[next])
+            {
+                distance[next] = nextDistance;
+                parent[next] = current;
+                directions[next] = 0;
+            }
+            else if (nextDistance > distance[next] || (directions[next] & (1 << dir)))
+            {
+                continue;
+            }
+
+            // the same cell with the same distance may still be needed in another direction.
+            directions[next] |= 1 << dir;
+            failed = !pushBucketQueue(&queue, nextDistance + getHeuristic(maze, next), next * 4 + dir);
+        }
+
+        node = popBucketQueue(&queue, &key);
+        if (node == -1)
+        {
+            break;
+        }
+    }
+
+    freeBucketQueue(&queue);
+    free(directions);
+    COUNT_EXPANDED(expanded);
+
+    if (failed)
+    {
+        free(distance);
+        free(parent);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    if (!found)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        STAT_PHASE(PHASE_PATH);
+        int *path = malloc(sizeof(int) * (distance[exitCell] + 1));
+        if (path == NULL)
+        {
+            free(distance);
+            free(parent);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        // fill the straight lines between the jump points.
+        int index = distance[exitCell];
+        int current = exitCell;
+        while (current != start)
+        {
+            const int previous = parent[current];
+            const int step = (previous % maze->width == current % maze->width)
+                             ? ((previous < current) ? -maze->width : maze->width)
+                             : ((previous < current) ? -1 : 1);
+
+            for (int cell = current; cell != previous; cell += step)
+            {
+                path[index--] = cell;
+            }
+            current = previous;
+        }
+        path[0] = start;
+
+        printCellPath(maze, path, distance[exitCell] + 1, writer);
+        free(path);
+    }
+
+    free(distance);
+    free(parent);
+}
+
+// This function returns the value of "cell" in the direction field.
+int getFieldDirection(const Field *field, const int cell)
+{
+    const unsigned char pair = field->directions[cell / 2];
+
+    return (cell % 2 == 0) ? (pair & 0x0F) : (pair >> 4);
+}
+
+// This function saves the value of "cell" into the direction field.
+void setFieldDirection(Field *field, const int cell, const int direction)
+{
+    unsigned char *pair = &field->directions[cell / 2];
+
+    if (cell % 2 == 0)
+    {
+        *pair = (*pair & 0xF0) | direction;
+    }
+    else
+    {
+        *pair = (*pair & 0x0F) | (direction << 4);
+    }
+}
+
+// This function uses BFS from all the exits to build the direction field.
+// Each reachable cell saves the move to its parent, which is one step closer to the nearest exit.
+// It returns false when it's unable to allocate memory.
+bool buildField(const Maze *maze, Field *field)
+{
+    if (maze->weighted)
+    {
+        return buildWeightedField(maze, field);
+    }
+
+    const int width = maze->width;
+    const int cells = width * maze->height;
+
+    field->width = width;
+    field->height = maze->height;
+    field->mapping = NULL;
+    field->directions = malloc(sizeof(unsigned char) * (cells / 2 + 1));
+    int *queue = malloc(sizeof(int) * cells);
+    if (field->directions == NULL || queue == NULL)
+    {
+        free(field->directions);
+        free(queue);
+        return false;
+    }
+
+    // every cell starts as unreachable.
+    memset(field->directions, FIELD_NONE | (FIELD_NONE << 4), sizeof(unsigned char) * (cells / 2 + 1));
+
+    // the BFS starts from all the exits at once.
+    for (int i = 0; i < maze->exitCount; ++i)
+    {
+        setFieldDirection(field, maze->exits[i], FIELD_EXIT);
+        queue[i] = maze->exits[i];
+    }
+    int head = 0;
+    int tail = maze->exitCount;
+    STAT_ADD(enqueued, tail);
+
+    while (head < tail)
+    {
+        const int current = queue[head++];
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int next = neighbours[i];
+            if (getFieldDirection(field, next) != FIELD_NONE)
+            {
+                continue;
+            }
+
+            // the move from "next" back to "current".
+            int direction;
+            if (next == current - width)
+            {
+                direction = DOWN;
+            }
+            else if (next == current + width)
+            {
+                direction = UP;
+            }
+            else if (next == current - 1)
+            {
+                direction = RIGHT;
+            }
+            else
+            {
+                direction = LEFT;
+            }
+
+            setFieldDirection(field, next, direction);
+            queue[tail++] = next;
+            STAT_ADD(enqueued, 1);
+            STAT_MAX(maxFrontier, tail - head);
+        }
+    }
+
+    // every cell in the queue has been expanded.
+    COUNT_EXPANDED(head);
+    free(queue);
+    return true;
+}
+
+// This function free the memory used by the direction field.
+void freeField(Field *field)
+{
+    if (field->mapping != NULL)
+    {
+        munmap(field->mapping, field->mappingSize);
+        field->mapping = NULL;
+    }
+    else
+    {
+        free(field->directions);
+    }
+
+    field->directions = NULL;
+}
+
+// This function reads the starting location of a query, "x y" or "x,y".
+// It returns false if the line is invalid.
+bool readQuery(const char *line, int *x, int *y)
+{
+    char *endPtr;
+    long num[2];
+
+    for (int i = 0; i < 2; ++i)
+    {
+        // skip the separator before each number.
+        while (isspace((unsigned char)*line) || (i == 1 && *line == ','))
+        {
+            line++;
+        }
+
+        if (!isdigit((unsigned char)*line))
+        {
+            return false;
+        }
+
+        errno = 0;
+        num[i] = strtol(line, &endPtr, 10);
+        if (errno != 0 || num[i] > INT_MAX)
+        {
+            return false;
+        }
+        line = endPtr;
+    }
+
+    // nothing else is allowed after two numbers.
+    while (isspace((unsigned char)*line))
+    {
+        line++;
+    }
+    if (*line != '\0')
+    {
+        return false;
+    }
+
+    *x = (int)num[0];
+    *y = (int)num[1];
+    return true;
+}
+
+// This function prints the path from (x, y) by following the direction field.
+void printFieldPath(const Maze *maze, const Field *field, const int x, const int y, PathWriter *writer)
+{
+    const int offset[4] = {-maze->width, maze->width, -1, 1};
+    int cell = y * maze->width + x;
+    int direction = getFieldDirection(field, cell);
+    STAT_PHASE(PHASE_OUTPUT);
+
+    if (direction == FIELD_NONE)
+    {
+        writePathCell(writer, x, y);
+        writeText(writer, "No escape possible.\n");
+        endPath(writer);
+        return;
+    }
+
+    while (true)
+    {
+        writePathCell(writer, cell % maze->width, cell / maze->width);
+        STAT_ADD(pathLength, 1);
+
+        if (direction == FIELD_EXIT)
+        {
+            break;
+        }
+
+        cell += offset[direction];
+        direction = getFieldDirection(field, cell);
+    }
+    endPath(writer);
+}
+
+// This function answers the queries from "input", one starting location per line.
+// The paths are read from "field", or searched with "search" if "field" is NULL.
+// Each answer ends with an empty line.
+// It returns false when error occurs.
+bool answerQueries(Maze *maze, const Field *field, HpaSearch *search, FILE *input, PathWriter *writer)
+{
+    char *line = NULL;
+    size_t limit = 0;
+
+    while (getline(&line, &limit, input) != -1)
+    {
+        int x, y;
+
+        // skip the empty lines.
+        if (strspn(line, " \t\r\n") == strlen(line))
+        {
+            continue;
+        }
+
+        if (!readQuery(line, &x, &y) || x >= maze->width || y >= maze->height ||
+            *(maze->cells + y * maze->stride + x) == '#')
+        {
+            puts("Invalid starting location!");
+        }
+        else if (field != NULL)
+        {
+            printFieldPath(maze, field, x, y, writer);
+        }
+        else if (!printHpaPath(maze, search, y * maze->width + x, writer))
+        {
+            free(line);
+            return false;
+        }
+
+        putchar('\n');
+    }
+
+    free(line);
+    return true;
+}
+
+// This function returns a 64-bit hash of the whole map file.
+// It reads 8 bytes at a time, so it's much faster than the parser.
+uint64_t hashMaze(const Maze *maze)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = maze->dataSize * multiplier;
+    size_t index = 0;
+
+    for (; index + 8 <= maze->dataSize; index += 8)
+    {
+        uint64_t word;
+        memcpy(&word, maze->data + index, sizeof(word));
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+
+    // hash the remaining bytes.
+    uint64_t word = 0;
+    memcpy(&word, maze->data + index, maze->dataSize - index);
+    hash = (hash ^ word) * multiplier;
+
+    hash ^= hash >> 32;
+    hash *= multiplier;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+// This function returns the path of the cache file, saved next to the map.
+// It returns NULL when it's unable to allocate memory.
+char *getCachePath(const char *path, const char *suffix)
+{
+    char *cachePath = malloc(sizeof(char) * (strlen(path) + strlen(suffix) + 1));
+    if (cachePath == NULL)
+    {
+        return NULL;
+    }
+
+    strcpy(cachePath, path);
+    strcat(cachePath, suffix);
+    return cachePath;
+}
+
+// This function maps the direction field from the cache file.
+// It returns false if the cache doesn't exist or belongs to another map.
+bool loadFieldCache(const char *cachePath, const Maze *maze, const uint64_t hash, Field *field)
+{
+    int fd = open(cachePath, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // check whether the cache is built from the same map.
+    const CacheHeader *header = mapping;
+    const size_t size = (size_t)maze->width * maze->height / 2 + 1;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->hash != hash || header->width != maze->width || header->height != maze->height ||
+        header->size != size || (size_t)info.st_size != sizeof(CacheHeader) + size)
+    {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    field->directions = (unsigned char *)mapping + sizeof(CacheHeader);
+    field->width = maze->width;
+    field->height = maze->height;
+    field->mapping = mapping;
+    field->mappingSize = info.st_size;
+    return true;
+}
+
+// This function saves the direction field into the cache file.
+// The cache is only an optimisation, so errors are ignored.
+void saveFieldCache(const char *cachePath, const Field *field, const uint64_t hash)
+{
+    // write a temporary file first, so a broken cache is never read.
+    char *tmpPath = malloc(sizeof(char) * (strlen(cachePath) + 5));
+    if (tmpPath == NULL)
+    {
+        return;
+    }
+    strcpy(tmpPath, cachePath);
+    strcat(tmpPath, ".tmp");
+
+    FILE *fPtr = fopen(tmpPath, "wb");
+    if (fPtr == NULL)
+    {
+        free(tmpPath);
+        return;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.hash = hash;
+    header.width = field->width;
+    header.height = field->height;
+    header.size = (size_t)field->width * field->height / 2 + 1;
+
+    bool written = fwrite(&header, sizeof(header), 1, fPtr) == 1 &&
+                   fwrite(field->directions, sizeof(unsigned char), header.size, fPtr) == header.size;
+
+    if (fclose(fPtr) != 0 || !written || rename(tmpPath, cachePath) != 0)
+    {
+        remove(tmpPath);
+    }
+
+    free(tmpPath);
+}
+
+// This function gets the direction field of the maze.
+// With "--cache", an unchanged map reads the field from its cache file,
+// otherwise the field is built and the cache file is rebuilt.
+// It returns false when it's unable to allocate memory.
+bool getField(const Maze *maze, const Options *options, Field *field)
+{
+    // only regular files can have a cache file next to them.
+    if (!options->useCache || !maze->regular)
+    {
+        return buildField(maze, field);
+    }
+
+    char *cachePath = getCachePath(options->path, CACHE_SUFFIX);
+    if (cachePath == NULL)
+    {
+        return false;
+    }
+
+    const uint64_t hash = hashMaze(maze);
+    if (loadFieldCache(cachePath, maze, hash, field))
+    {
+        free(cachePath);
+        return true;
+    }
+
+    if (!buildField(maze, field))
+    {
+        free(cachePath);
+        return false;
+    }
+
+    saveFieldCache(cachePath, field, hash);
+    free(cachePath);
+    return true;
+}
+
+// This function appends a cell to the local frontier of a thread.
+// It returns false when it's unable to allocate memory.
+bool appendWorkerCell(Worker *worker, const int cell)
+{
+    // malloc more memory when reach the limit
+    if (worker->size == worker->limit)
+    {
+        int limit = worker->limit == 0 ? BUCKET_SIZE : worker->limit * 2;
+        int *cells = realloc(worker->cells, sizeof(int) * limit);
+        if (cells == NULL)
+        {
+            return false;
+        }
+
+        worker->cells = cells;
+        worker->limit = limit;
+    }
+
+    worker->cells[worker->size++] = cell;
+    return true;
+}
+
+// This function is run by every thread of the parallel BFS.
+// The small levels are expanded by the first thread alone while the others wait at a barrier.
+// A large level is expanded in three steps separated by barriers:
+// expand a slice of the frontier, copy the local cells into the next frontier,
+// then the first thread swaps the frontiers.
+void *expandLevels(void *arg)
+{
+    Worker *worker = arg;
+    ParallelSearch *search = worker->search;
+    const Maze *maze = search->maze;
+    const int cells = maze->width * maze->height;
+
+    // wait until all the threads have been created.
+    pthread_mutex_lock(&search->lock);
+    while (!search->ready)
+    {
+        pthread_cond_wait(&search->readyCond, &search->lock);
+    }
+    pthread_mutex_unlock(&search->lock);
+
+    const int threadCount = search->threadCount;
+
+    // each thread initializes its own part of "distance".
+    const int first = (int)((long)cells * worker->id / threadCount);
+    const int last = (int)((long)cells * (worker->id + 1) / threadCount);
+    memset(search->distance + first, -1, sizeof(int) * (last - first));
+    pthread_barrier_wait(&search->barrier);
+
+    if (worker->id == 0)
+    {
+        search->distance[search->frontier[0]] = 0;
+    }
+    pthread_barrier_wait(&search->barrier);
+
+    while (true)
+    {
+        if (worker->id == 0)
+        {
+            expandSmallLevels(search);
+        }
+        pthread_barrier_wait(&search->barrier);
+        if (search->finished)
+        {
+            break;
+        }
+
+        const int begin = (int)((long)search->frontierSize * worker->id / threadCount);
+        const int end = (int)((long)search->frontierSize * (worker->id + 1) / threadCount);
+
+        for (int i = begin; i < end; ++i)
+        {
+            int neighbours[4];
+            const int count = getNeighbours(maze, search->frontier[i], neighbours);
+
+            for (int j = 0; j < count; ++j)
+            {
+                const int next = neighbours[j];
+                const uint64_t bit = (uint64_t)1 << (next % 64);
+                atomic_uint_fast64_t *word = &search->visited[next / 64];
+
+                // only the thread which sets the bit owns the cell.
+                if ((atomic_load_explicit(word, memory_order_relaxed) & bit) != 0 ||
+                    (atomic_fetch_or_explicit(word, bit, memory_order_relaxed) & bit) != 0)
+                {
+                    continue;
+                }
+
+                // every parent of this level gives the same distance.
+                search->distance[next] = search->level + 1;
+
+                // keep the smallest exit of this level, so the path doesn't depend on the threads.
+                if (*(maze->cells + (next / maze->width) * maze->stride + next % maze->width) == 'x')
+                {
+                    int exitCell = atomic_load(&search->exitCell);
+                    while (next < exitCell && !atomic_compare_exchange_weak(&search->exitCell, &exitCell, next))
+                    {
+                    }
+                    atomic_store(&search->found, true);
+                }
+                if (!appendWorkerCell(worker, next))
+                {
+                    atomic_store(&search->failed, true);
+                }
+            }
+        }
+        pthread_barrier_wait(&search->barrier);
+
+        // the first thread works out where each local frontier goes.
+        if (worker->id == 0)
+        {
+            int offset = 0;
+            for (int i = 0; i < threadCount; ++i)
+            {
+                search->workers[i].offset = offset;
+                offset += search->workers[i].size;
+            }
+            COUNT_EXPANDED(search->frontierSize);
+            STAT_ADD(enqueued, offset);
+            STAT_MAX(maxFrontier, offset);
+            search->frontierSize = offset;
+        }
+        pthread_barrier_wait(&search->barrier);
+
+        memcpy(search->next + worker->offset, worker->cells, sizeof(int) * worker->size);
+        worker->size = 0;
+        pthread_barrier_wait(&search->barrier);
+
+        if (worker->id == 0)
+        {
+            int *tmp = search->frontier;
+            search->frontier = search->next;
+            search->next = tmp;
+            search->level++;
+
+            search->finished = atomic_load(&search->found) || atomic_load(&search->failed) ||
+                               search->frontierSize == 0;
+        }
+    }
+
+    return NULL;
+}
+
+// This function expands the levels of the parallel BFS on the calling thread,
+// until the search is finished or the frontier is large enough to be split between the threads.
+// Only one thread runs at that time, so the atomics are read and written without locking.
+void expandSmallLevels(ParallelSearch *search)
+{
+    const Maze *maze = search->maze;
+    // a single thread expands every level here.
+    const int threshold = (search->threadCount == 1) ? INT_MAX : search->threadCount * PARALLEL_LEVEL_SIZE;
+    uint64_t expanded = 0;
+
+    while (!search->finished && search->frontierSize < threshold)
+    {
+        int size = 0;
+        int exitCell = INT_MAX;
+
+        for (int i = 0; i < search->frontierSize; ++i)
+        {
+            int neighbours[4];
+            const int count = getNeighbours(maze, search->frontier[i], neighbours);
+
+            for (int j = 0; j < count; ++j)
+            {
+                const int next = neighbours[j];
+                const uint64_t bit = (uint64_t)1 << (next % 64);
+                atomic_uint_fast64_t *word = &search->visited[next / 64];
+                const uint64_t value = atomic_load_explicit(word, memory_order_relaxed);
+                if ((value & bit) != 0)
+                {
+                    continue;
+                }
+
+                atomic_store_explicit(word, value | bit, memory_order_relaxed);
+                search->distance[next] = search->level + 1;
+                search->next[size++] = next;
+
+                // keep the smallest exit of this level, like the threads do.
+                if (*(maze->cells + (next / maze->width) * maze->stride + next % maze->width) == 'x' &&
+                    next < exitCell)
+                {
+                    exitCell = next;
+                }
+            }
+        }
+
+        expanded += search->frontierSize;
+        STAT_ADD(enqueued, size);
+        STAT_MAX(maxFrontier, size);
+
+        int *tmp = search->frontier;
+        search->frontier = search->next;
+        search->next = tmp;
+        search->frontierSize = size;
+        search->level++;
+
+        if (exitCell != INT_MAX)
+        {
+            atomic_store(&search->exitCell, exitCell);
+            atomic_store(&search->found, true);
+        }
+        search->finished = exitCell != INT_MAX || size == 0;
+    }
+
+    COUNT_EXPANDED(expanded);
+}
+
+// This function uses a level-synchronous BFS on several threads to find the shortest path.
+// The path is rebuilt from the distances, so it's the same for any number of threads.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathParallel(Maze *maze, const int x, const int y, const int threadCount, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    const int cells = maze->width * maze->height;
+
+    ParallelSearch search;
+    search.maze = maze;
+    search.distance = malloc(sizeof(int) * cells);
+    search.visited = calloc(cells / 64 + 1, sizeof(atomic_uint_fast64_t));
+    search.frontier = malloc(sizeof(int) * cells);
+    search.next = malloc(sizeof(int) * cells);
+    Worker *workers = calloc(threadCount, sizeof(Worker));
+    pthread_t *threads = malloc(sizeof(pthread_t) * threadCount);
+
+    if (search.distance == NULL || search.visited == NULL || search.frontier == NULL ||
+        search.next == NULL || workers == NULL || threads == NULL)
+    {
+        free(search.distance);
+        free(search.visited);
+        free(search.frontier);
+        free(search.next);
+        free(workers);
+        free(threads);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    const int start = y * maze->width + x;
+    search.frontier[0] = start;
+    search.frontierSize = 1;
+    search.visited[start / 64] = (uint64_t)1 << (start % 64);
+    search.level = 0;
+    atomic_init(&search.exitCell, INT_MAX);
+    atomic_init(&search.found, false);
+    atomic_init(&search.failed, false);
+    search.finished = false;
+    search.workers = workers;
+    search.ready = false;
+    pthread_mutex_init(&search.lock, NULL);
+    pthread_cond_init(&search.readyCond, NULL);
+
+    // the main thread is the first worker.
+    // If some threads can't be created, the search uses fewer threads.
+    int started = 1;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        workers[i].search = &search;
+        workers[i].id = i;
+    }
+    for (; started < threadCount; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, expandLevels, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    search.threadCount = started;
+    pthread_barrier_init(&search.barrier, NULL, started);
+
+    pthread_mutex_lock(&search.lock);
+    search.ready = true;
+    pthread_cond_broadcast(&search.readyCond);
+    pthread_mutex_unlock(&search.lock);
+
+    expandLevels(&workers[0]);
+
+    for (int i = 1; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&search.barrier);
+    pthread_cond_destroy(&search.readyCond);
+    pthread_mutex_destroy(&search.lock);
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        free(workers[i].cells);
+    }
+    free(workers);
+    free(threads);
+    free(search.visited);
+    free(search.frontier);
+    free(search.next);
+
+    if (atomic_load(&search.failed))
+    {
+        free(search.distance);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    if (!atomic_load(&search.found))
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        STAT_PHASE(PHASE_PATH);
+        const int exitCell = atomic_load(&search.exitCell);
+        const int length = search.distance[exitCell] + 1;
+        int *path = malloc(sizeof(int) * length);
+        if (path == NULL)
+        {
+            free(search.distance);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        descendPath(maze, search.distance, exitCell, path + length - 1, -1);
+        printCellPath(maze, path, length, writer);
+        free(path);
+    }
+
+    free(search.distance);
+}
+
+// This function sets the bits of the open cells and of the exits in the grid, and clears the level tags.
+// Each row starts at a new word, and bit "i" of a word is column "i" of that word.
+void buildGridWords(const Maze *maze, GridWord *grid, const int wordsPerRow)
+{
+    for (int row = 0; row < maze->height; ++row)
+    {
+        const char *line = maze->cells + row * maze->stride;
+        GridWord *words = grid + (size_t)row * wordsPerRow;
+        int col = 0;
+
+#ifdef __SSE2__
+        const __m128i wallChars = _mm_set1_epi8('#');
+        const __m128i exitChars = _mm_set1_epi8('x');
+
+        // compare 64 chars at a time.
+        for (; col + 64 <= maze->width; col += 64)
+        {
+            uint64_t walls = 0;
+            uint64_t exits = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128i chunk = _mm_loadu_si128((const __m128i *)(line + col + i * 16));
+                walls |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, wallChars)) << (i * 16);
+                exits |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, exitChars)) << (i * 16);
+            }
+            words[col / 64] = (GridWord){~walls, exits, 0, 0};
+        }
+#endif
+
+        // the last word is padded with walls.
+        for (; col < maze->width; col += 64)
+        {
+            uint64_t open = 0;
+            uint64_t exits = 0;
+            for (int i = 0; i < 64 && col + i < maze->width; ++i)
+            {
+                if (line[col + i] != '#')
+                {
+                    open |= (uint64_t)1 << i;
+                }
+                if (line[col + i] == 'x')
+                {
+                    exits |= (uint64_t)1 << i;
+                }
+            }
+            words[col / 64] = (GridWord){open, exits, 0, 0};
+        }
+    }
+}
+
+// This function finds the next level by checking the unvisited cells next to the frontier, 64 at a time.
+// A cell joins the next frontier if one of its four neighbours is in the frontier,
+// which is found by shifting the words of the same row and reading the rows above and below.
+// Only the rows next to the frontier are swept, and in each row only the words next to its frontier words.
+// Each row of the frontier is cleared once the row below it has been swept.
+// The new cells are tagged with their level in the grid, and the smallest exit among them is saved into "exitCell".
+// It returns the number of cells in the next frontier.
+int sweepBottomUp(const Maze *maze, GridWord *grid, const int wordsPerRow, BitFrontier *frontier, BitFrontier *next,
+                  const int level, int *exitCell)
+{
+    const int height = maze->height;
+    const int firstRow = (frontier->minRow > 0) ? frontier->minRow - 1 : 0;
+    const int lastRow = (frontier->maxRow < height - 1) ? frontier->maxRow + 1 : height - 1;
+    const int tag = getLevelTag(level + 1);
+    int count = 0;
+
+    next->minRow = INT_MAX;
+    next->maxRow = -1;
+
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        // the words next to the frontier words of this row and of the rows above and below.
+        int low = frontier->first[row];
+        int high = frontier->last[row];
+        if (row > 0)
+        {
+            low = (frontier->first[row - 1] < low) ? frontier->first[row - 1] : low;
+            high = (frontier->last[row - 1] > high) ? frontier->last[row - 1] : high;
+        }
+        if (row < height - 1)
+        {
+            low = (frontier->first[row + 1] < low) ? frontier->first[row + 1] : low;
+            high = (frontier->last[row + 1] > high) ? frontier->last[row + 1] : high;
+        }
+        low = (low > 0) ? low - 1 : 0;
+        high = (high < wordsPerRow - 1) ? high + 1 : wordsPerRow - 1;
+
+        const size_t base = (size_t)row * wordsPerRow;
+        const uint64_t *current = frontier->bits + base;
+        GridWord *words = grid + base;
+
+        for (int i = low; i <= high; ++i)
+        {
+            // the neighbours on the left and right, with the bits carried over between words.
+            uint64_t reached = (current[i] << 1) | (current[i] >> 1);
+            if (i > 0)
+            {
+                reached |= current[i - 1] >> 63;
+            }
+            if (i < wordsPerRow - 1)
+            {
+                reached |= current[i + 1] << 63;
+            }
+            if (row > 0)
+            {
+                reached |= current[i - wordsPerRow];
+            }
+            if (row < height - 1)
+            {
+                reached |= current[i + wordsPerRow];
+            }
+
+            const uint64_t found = reached & words[i].unvisited;
+            if (found == 0)
+            {
+                continue;
+            }
+
+            next->bits[base + i] = found;
+            words[i].unvisited &= ~found;
+            setLevelTags(&words[i], found, tag);
+            next->first[row] = (i < next->first[row]) ? i : next->first[row];
+            next->last[row] = i;
+            next->minRow = (row < next->minRow) ? row : next->minRow;
+            next->maxRow = row;
+            count += __builtin_popcountll(found);
+
+            const uint64_t exits = found & words[i].exits;
+            if (exits != 0)
+            {
+                const int cell = row * maze->width + i * 64 + __builtin_ctzll(exits);
+                *exitCell = (*exitCell == -1 || cell < *exitCell) ? cell : *exitCell;
+            }
+        }
+
+        if (row > frontier->minRow)
+        {
+            clearBitFrontierRow(frontier, row - 1, wordsPerRow);
+        }
+    }
+
+    for (int row = (lastRow > frontier->minRow) ? lastRow : frontier->minRow; row <= frontier->maxRow; ++row)
+    {
+        clearBitFrontierRow(frontier, row, wordsPerRow);
+    }
+    frontier->minRow = INT_MAX;
+    frontier->maxRow = -1;
+    return count;
+}
+
+// This function clears the words of one row of a bitset frontier.
+void clearBitFrontierRow(BitFrontier *frontier, const int row, const int wordsPerRow)
+{
+    uint64_t *words = frontier->bits + (size_t)row * wordsPerRow;
+    for (int i = frontier->first[row]; i <= frontier->last[row]; ++i)
+    {
+        words[i] = 0;
+    }
+
+    frontier->first[row] = wordsPerRow;
+    frontier->last[row] = -1;
+}
+
+// This function saves the cells of a bitset frontier into "cells" and empties it.
+// It returns the number of cells.
+int listBitFrontier(BitFrontier *frontier, const int width, const int wordsPerRow, int *cells)
+{
+    int count = 0;
+
+    for (int row = frontier->minRow; row <= frontier->maxRow; ++row)
+    {
+        const uint64_t *words = frontier->bits + (size_t)row * wordsPerRow;
+        for (int i = frontier->first[row]; i <= frontier->last[row]; ++i)
+        {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1)
+            {
+                cells[count++] = row * width + i * 64 + __builtin_ctzll(word);
+            }
+        }
+
+        clearBitFrontierRow(frontier, row, wordsPerRow);
+    }
+
+    frontier->minRow = INT_MAX;
+    frontier->maxRow = -1;
+    return count;
+}
+
+// This function returns the tag of a level, which is 1, 2 or 3.
+// The neighbours of a cell are one level before, on the same level or one level after it,
+// so the tag is enough to tell the level of a neighbour.
+int getLevelTag(const int level)
+{
+    return level % 3 + 1;
+}
+
+// This function tags the cells of one word with a level tag.
+void setLevelTags(GridWord *word, const uint64_t cells, const int tag)
+{
+    if (tag & 1)
+    {
+        word->low |= cells;
+    }
+    if (tag & 2)
+    {
+        word->high |= cells;
+    }
+}
+
+// This function returns the level tag of the cell at (row, col), or 0 if it has not been reached.
+int getCellTag(const GridWord *grid, const int wordsPerRow, const int row, const int col)
+{
+    const GridWord *word = grid + (size_t)row * wordsPerRow + col / 64;
+    const int bit = col % 64;
+
+    return (int)((word->low >> bit) & 1) | (int)(((word->high >> bit) & 1) << 1);
+}
+
+// This function follows the level tags down from "cell", which is "distance" steps away from the start.
+// The cells are saved into "path" from the end, and the neighbours are tried in the order of "getNeighbours".
+void descendTaggedPath(const Maze *maze, const GridWord *grid, int cell, const int distance, int *path)
+{
+    const int wordsPerRow = (maze->width + 63) / 64;
+    path[distance] = cell;
+
+    for (int level = distance - 1; level >= 0; --level)
+    {
+        const int row = cell / maze->width;
+        const int col = cell % maze->width;
+        const int tag = getLevelTag(level);
+
+        if (row > 0 && getCellTag(grid, wordsPerRow, row - 1, col) == tag)
+        {
+            cell -= maze->width;
+        }
+        else if (row < maze->height - 1 && getCellTag(grid, wordsPerRow, row + 1, col) == tag)
+        {
+            cell += maze->width;
+        }
+        else if (col > 0 && getCellTag(grid, wordsPerRow, row, col - 1) == tag)
+        {
+            cell--;
+        }
+        else
+        {
+            cell++;
+        }
+
+        path[level] = cell;
+    }
+}
+
+// This function uses direction-optimizing BFS to find the shortest path.
+// Small frontiers are expanded top-down from a list of cells, like the normal BFS.
+// Large frontiers are kept as bitsets and the next level is found bottom-up,
+// so the unvisited cells next to the frontier are checked 64 at a time.
+// The levels are only kept as tags of two bits, so the search never touches an array of ints of the size of the map.
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathDirectionOptimizing(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    const int width = maze->width;
+    const int height = maze->height;
+    const int cells = width * height;
+    const int wordsPerRow = (width + 63) / 64;
+    const size_t totalWords = (size_t)wordsPerRow * height;
+
+    GridWord *grid = malloc(sizeof(GridWord) * totalWords);
+    int *frontier = malloc(sizeof(int) * cells);
+    int *next = malloc(sizeof(int) * cells);
+    BitFrontier bits[2];
+    bool ready = grid != NULL && frontier != NULL && next != NULL;
+    for (int i = 0; i < 2; ++i)
+    {
+        bits[i].bits = calloc(totalWords, sizeof(uint64_t));
+        bits[i].first = malloc(sizeof(int) * height);
+        bits[i].last = malloc(sizeof(int) * height);
+        ready = ready && bits[i].bits != NULL && bits[i].first != NULL && bits[i].last != NULL;
+    }
+
+    if (!ready)
+    {
+        freeDirectionSearch(grid, frontier, next, bits);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    // every row of both bitsets starts empty.
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int row = 0; row < height; ++row)
+        {
+            bits[i].first[row] = wordsPerRow;
+            bits[i].last[row] = -1;
+        }
+        bits[i].minRow = INT_MAX;
+        bits[i].maxRow = -1;
+    }
+
+    buildGridWords(maze, grid, wordsPerRow);
+    long openCells = 0;
+    for (size_t i = 0; i < totalWords; ++i)
+    {
+        openCells += __builtin_popcountll(grid[i].unvisited);
+    }
+
+    GridWord *startWord = grid + (size_t)y * wordsPerRow + x / 64;
+    startWord->unvisited &= ~((uint64_t)1 << (x % 64));
+    setLevelTags(startWord, (uint64_t)1 << (x % 64), getLevelTag(0));
+    frontier[0] = y * width + x;
+    int frontierSize = 1;
+    long unvisitedCount = openCells - 1;
+    int exitCell = -1;
+    bool bottomUp = false;
+    int level = 0;
+    uint64_t expanded = 0;
+    STAT_ADD(enqueued, 1);
+
+    while (frontierSize > 0 && exitCell == -1)
+    {
+        expanded += frontierSize;
+
+        if (!bottomUp && 4L * frontierSize * BOTTOM_UP_ALPHA > unvisitedCount)
+        {
+            // switch to bottom-up, move the frontier into the bitset.
+            BitFrontier *current = &bits[0];
+            for (int i = 0; i < frontierSize; ++i)
+            {
+                const int row = frontier[i] / width;
+                const int col = frontier[i] % width;
+                const int word = col / 64;
+                current->bits[(size_t)row * wordsPerRow + word] |= (uint64_t)1 << (col % 64);
+                current->first[row] = (word < current->first[row]) ? word : current->first[row];
+                current->last[row] = (word > current->last[row]) ? word : current->last[row];
+                current->minRow = (row < current->minRow) ? row : current->minRow;
+                current->maxRow = (row > current->maxRow) ? row : current->maxRow;
+            }
+            bottomUp = true;
+        }
+        else if (bottomUp && 4L * frontierSize * BOTTOM_UP_BETA < unvisitedCount)
+        {
+            // switch to top-down, move the frontier into the list.
+            listBitFrontier(&bits[0], width, wordsPerRow, frontier);
+            bottomUp = false;
+        }
+
+        if (bottomUp)
+        {
+            frontierSize = sweepBottomUp(maze, grid, wordsPerRow, &bits[0], &bits[1], level, &exitCell);
+
+            BitFrontier tmp = bits[0];
+            bits[0] = bits[1];
+            bits[1] = tmp;
+            STAT_ADD(bottomUpLevels, 1);
+        }
+        else
+        {
+            const int tag = getLevelTag(level + 1);
+            int nextSize = 0;
+
+            for (int i = 0; i < frontierSize; ++i)
+            {
+                const int row = frontier[i] / width;
+                const int col = frontier[i] % width;
+
+                // the neighbours in the same order as "getNeighbours", the walls are never unvisited.
+                // The moves left and right change the word at the first and the last bit of a word.
+                const size_t index = (size_t)row * wordsPerRow + col / 64;
+                const int bit = col % 64;
+                const bool inside[4] = {row > 0, row < height - 1, col > 0, col < width - 1};
+                const size_t words[4] = {index - wordsPerRow, index + wordsPerRow, index - (bit == 0),
+                                         index + (bit == 63)};
+                const int shifts[4] = {bit, bit, (bit + 63) % 64, (bit + 1) % 64};
+                const int neighbours[4] = {frontier[i] - width, frontier[i] + width, frontier[i] - 1, frontier[i] + 1};
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    const uint64_t mask = (uint64_t)1 << shifts[j];
+                    if (!inside[j] || (grid[words[j]].unvisited & mask) == 0)
+                    {
+                        continue;
+                    }
+
+                    GridWord *word = &grid[words[j]];
+                    word->unvisited &= ~mask;
+                    setLevelTags(word, mask, tag);
+                    next[nextSize++] = neighbours[j];
+
+                    // keep the smallest exit of this level, like the bottom-up sweep.
+                    if ((word->exits & mask) && (exitCell == -1 || neighbours[j] < exitCell))
+                    {
+                        exitCell = neighbours[j];
+                    }
+                }
+            }
+
+            int *tmp = frontier;
+            frontier = next;
+            next = tmp;
+            frontierSize = nextSize;
+        }
+
+        unvisitedCount -= frontierSize;
+        STAT_ADD(enqueued, frontierSize);
+        STAT_MAX(maxFrontier, frontierSize);
+        level++;
+    }
+
+    COUNT_EXPANDED(expanded);
+
+    if (exitCell == -1)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        // the exit was found on the last level.
+        STAT_PHASE(PHASE_PATH);
+        int *path = malloc(sizeof(int) * (level + 1));
+        if (path == NULL)
+        {
+            freeDirectionSearch(grid, frontier, next, bits);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        descendTaggedPath(maze, grid, exitCell, level, path);
+        printCellPath(maze, path, level + 1, writer);
+        free(path);
+    }
+
+    freeDirectionSearch(grid, frontier, next, bits);
+}
+
+// This function frees the memory of the direction-optimizing BFS.
+void freeDirectionSearch(GridWord *grid, int *frontier, int *next, BitFrontier *bits)
+{
+    free(grid);
+    free(frontier);
+    free(next);
+    for (int i = 0; i < 2; ++i)
+    {
+        free(bits[i].bits);
+        free(bits[i].first);
+        free(bits[i].last);
+    }
+}
+
+// This function returns the cell of the blocked grid at (x, y) of the maze.
+int getBlockedCell(const BlockedGrid *grid, const int x, const int y)
+{
+    const int gridX = x + 1;
+    const int gridY = y + 1;
+
+    return (gridY >> BLOCK_SHIFT) * grid->rowSize + (gridX >> BLOCK_SHIFT) * BLOCK_CELLS +
+           ((gridY & (BLOCK_SIDE - 1)) << BLOCK_SHIFT) + (gridX & (BLOCK_SIDE - 1));
+}
+
+// This function returns the cell number in the maze of a cell of the blocked grid.
+int getBlockedMazeCell(const Maze *maze, const BlockedGrid *grid, const int cell)
+{
+    const int block = cell / BLOCK_CELLS;
+    const int gridX = (block % grid->blocksX) * BLOCK_SIDE + (cell & (BLOCK_SIDE - 1));
+    const int gridY = (block / grid->blocksX) * BLOCK_SIDE + ((cell >> BLOCK_SHIFT) & (BLOCK_SIDE - 1));
+
+    return (gridY - 1) * maze->width + gridX - 1;
+}
+
+// This function returns the neighbour of "cell" in the direction "dir".
+// The move depends only on the place of the cell in its block, so it's read from a table.
+int moveBlocked(const BlockedGrid *grid, const int cell, const int dir)
+{
+    return cell + grid->moves[dir][cell & (BLOCK_CELLS - 1)];
+}
+
+// This function copies the maze into the blocked layout.
+// It returns false when it's unable to allocate memory.
+bool buildBlockedGrid(const Maze *maze, BlockedGrid *grid)
+{
+    // one more cell of walls on each side.
+    grid->blocksX = (maze->width + 2 + BLOCK_SIDE - 1) / BLOCK_SIDE;
+    grid->blocksY = (maze->height + 2 + BLOCK_SIDE - 1) / BLOCK_SIDE;
+    grid->rowSize = grid->blocksX * BLOCK_CELLS;
+
+    // only the moves out of a block jump to the next block.
+    for (int i = 0; i < BLOCK_CELLS; ++i)
+    {
+        const int column = i & (BLOCK_SIDE - 1);
+        const int row = i >> BLOCK_SHIFT;
+
+        grid->moves[UP][i] = (row > 0) ? -BLOCK_SIDE : -grid->rowSize + BLOCK_CELLS - BLOCK_SIDE;
+        grid->moves[DOWN][i] = (row < BLOCK_SIDE - 1) ? BLOCK_SIDE : grid->rowSize - BLOCK_CELLS + BLOCK_SIDE;
+        grid->moves[LEFT][i] = (column > 0) ? -1 : -BLOCK_CELLS + BLOCK_SIDE - 1;
+        grid->moves[RIGHT][i] = (column < BLOCK_SIDE - 1) ? 1 : BLOCK_CELLS - BLOCK_SIDE + 1;
+    }
+
+    grid->cells = calloc((size_t)grid->rowSize * grid->blocksY, sizeof(unsigned char));
+    if (grid->cells == NULL)
+    {
+        return false;
+    }
+
+    for (int y = 0; y < maze->height; ++y)
+    {
+        const char *line = maze->cells + y * maze->stride;
+        for (int x = 0; x < maze->width; ++x)
+        {
+            if (line[x] != '#')
+            {
+                grid->cells[getBlockedCell(grid, x, y)] = (line[x] == 'x') ? BLOCKED_EXIT : BLOCKED_OPEN;
+            }
+        }
+    }
+
+    return true;
+}
+
+// This function uses BFS on a copy of the maze in the blocked layout to find the shortest path.
+// The cells above and below are usually in the same cache line, which helps on wide maps.
+// The path is the same as the one found by "getShortestPath".
+// It calls "errorHandle" fucntion when error occurs.
+void getShortestPathBlocked(Maze *maze, const int x, const int y, PathWriter *writer)
+{
+    if (checkStartingLocation(maze, x, y))
+    {
+        return;
+    }
+
+    BlockedGrid grid;
+    int *queue = malloc(sizeof(int) * maze->width * maze->height);
+    if (queue == NULL || !buildBlockedGrid(maze, &grid))
+    {
+        free(queue);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    const int start = getBlockedCell(&grid, x, y);
+    int head = 0;
+    int tail = 0;
+    int exitCell = -1;
+    grid.cells[start] |= BLOCKED_VISITED;
+    queue[tail++] = start;
+    STAT_ADD(enqueued, 1);
+
+    while (head < tail && exitCell == -1)
+    {
+        const int current = queue[head++];
+
+        for (int dir = UP; dir <= RIGHT; ++dir)
+        {
+            const int next = moveBlocked(&grid, current, dir);
+            const unsigned char value = grid.cells[next];
+            if (value == BLOCKED_WALL || (value & BLOCKED_VISITED))
+            {
+                continue;
+            }
+
+            // the parent is in the opposite direction.
+            grid.cells[next] = value | BLOCKED_VISITED | ((dir ^ 1) << 3);
+            queue[tail++] = next;
+            STAT_ADD(enqueued, 1);
+            STAT_MAX(maxFrontier, tail - head);
+
+            if (value == BLOCKED_EXIT)
+            {
+                exitCell = next;
+                break;
+            }
+        }
+    }
+
+    COUNT_EXPANDED(head);
+    free(queue);
+
+    if (exitCell == -1)
+    {
+        printf("%d,%d\n", x, y);
+        puts("No escape possible.");
+    }
+    else
+    {
+        STAT_PHASE(PHASE_PATH);
+
+        // count the steps back to the start, then save them from the end.
+        int length = 1;
+        for (int cell = exitCell; cell != start; cell = moveBlocked(&grid, cell, grid.cells[cell] >> 3))
+        {
+            length++;
+        }
+
+        int *path = malloc(sizeof(int) * length);
+        if (path == NULL)
+        {
+            free(grid.cells);
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        int cell = exitCell;
+        for (int i = length - 1; i >= 0; --i)
+        {
+            path[i] = getBlockedMazeCell(maze, &grid, cell);
+            cell = moveBlocked(&grid, cell, grid.cells[cell] >> 3);
+        }
+
+        printCellPath(maze, path, length, writer);
+        free(path);
+    }
+
+    free(grid.cells);
+}
+
+// This function returns the smallest key in a bucket queue, or -1 if it's empty.
+int peekBucketQueue(BucketQueue *queue)
+{
+    if (queue->size == 0)
+    {
+        return -1;
+    }
+
+    // skip the empty buckets.
+    while (queue->buckets[queue->current % queue->count].size == 0)
+    {
+        queue->current++;
+    }
+
+    return queue->current;
+}
+
+// This function empties a bucket queue, so it can be used again.
+void clearBucketQueue(BucketQueue *queue)
+{
+    for (int i = 0; i < queue->count; ++i)
+    {
+        queue->buckets[i].size = 0;
+    }
+
+    queue->current = 0;
+    queue->size = 0;
+}
+
+// This function returns the cluster of "cell".
+int getCluster(const Maze *maze, const HpaIndex *index, const int cell)
+{
+    const int x = cell % maze->width;
+    const int y = cell / maze->width;
+
+    return (y / index->clusterSize) * index->clustersX + x / index->clusterSize;
+}
+
+// This function returns the node at "cell", or -1 if the cell isn't a node.
+int findHpaNode(const Maze *maze, const HpaIndex *index, const int cell)
+{
+    const int cluster = getCluster(maze, index, cell);
+    int low = index->firstNode[cluster];
+    int high = index->firstNode[cluster + 1] - 1;
+
+    // the nodes of a cluster are sorted by cell.
+    while (low <= high)
+    {
+        const int middle = low + (high - low) / 2;
+
+        if (index->nodes[middle] == cell)
+        {
+            return middle;
+        }
+        else if (index->nodes[middle] < cell)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+// This function adds "cell" to the end of a list.
+// It returns false when error occurs.
+bool appendCell(int **cells, int *count, int *limit, const int cell)
+{
+    // malloc more memory when reach the limit
+    if (*count == *limit)
+    {
+        int newLimit = *limit == 0 ? EXIT_LIST_SIZE : *limit * 2;
+        int *newCells = realloc(*cells, sizeof(int) * newLimit);
+        if (newCells == NULL)
+        {
+            return false;
+        }
+
+        *cells = newCells;
+        *limit = newLimit;
+    }
+
+    (*cells)[(*count)++] = cell;
+    return true;
+}
+
+// This function adds the entrances on a border between two clusters to a list of cells.
+// The border starts at "first" and goes on by "step", the other cluster is "across" away.
+// A short entrance has one node in the middle, a long one has a node at each end.
+// "side" chooses the cells of the first or the second cluster.
+// It returns false when error occurs.
+bool addEntrances(const Maze *maze, const int first, const int step, const int across, const int length,
+                  const int side, int **cells, int *count, int *limit)
+{
+    int runStart = -1;
+
+    for (int i = 0; i <= length; ++i)
+    {
+        const int cell = first + i * step;
+        const bool open = i < length && getCost(maze, cell) != 0 && getCost(maze, cell + across) != 0;
+
+        if (open && runStart == -1)
+        {
+            runStart = i;
+        }
+        else if (!open && runStart != -1)
+        {
+            const int runEnd = i - 1;
+            bool added;
+
+            if (runEnd - runStart + 1 < ENTRANCE_SPLIT)
+            {
+                added = appendCell(cells, count, limit, first + (runStart + runEnd) / 2 * step + side * across);
+            }
+            else
+            {
+                added = appendCell(cells, count, limit, first + runStart * step + side * across) &&
+                        appendCell(cells, count, limit, first + runEnd * step + side * across);
+            }
+
+            if (!added)
+            {
+                return false;
+            }
+            runStart = -1;
+        }
+    }
+
+    return true;
+}
+
+// This function collects the nodes of a cluster, sorted by cell.
+// They are the entrances on its four borders and the exits inside it.
+// It returns false when error occurs.
+bool collectClusterNodes(const Maze *maze, const HpaIndex *index, const int cluster,
+                         int **cells, int *count, int *limit)
+{
+    const int size = index->clusterSize;
+    const int width = maze->width;
+    const int x0 = (cluster % index->clustersX) * size;
+    const int y0 = (cluster / index->clustersX) * size;
+    const int x1 = (x0 + size < width) ? x0 + size : width;
+    const int y1 = (y0 + size < maze->height) ? y0 + size : maze->height;
+    const int first = *count;
+
+    // each border is scanned from the same cells by both clusters, so they agree on the entrances.
+    bool added = true;
+    if (x0 > 0)
+    {
+        added = added && addEntrances(maze, y0 * width + x0 - 1, width, 1, y1 - y0, 1, cells, count, limit);
+    }
+    if (x1 < width)
+    {
+        added = added && addEntrances(maze, y0 * width + x1 - 1, width, 1, y1 - y0, 0, cells, count, limit);
+    }
+    if (y0 > 0)
+    {
+        added = added && addEntrances(maze, (y0 - 1) * width + x0, 1, width, x1 - x0, 1, cells, count, limit);
+    }
+    if (y1 < maze->height)
+    {
+        added = added && addEntrances(maze, (y1 - 1) * width + x0, 1, width, x1 - x0, 0, cells, count, limit);
+    }
+
+    for (int y = y0; y < y1 && added; ++y)
+    {
+        const char *line = maze->cells + y * maze->stride;
+        const char *exitPtr = memchr(line + x0, 'x', x1 - x0);
+
+        while (exitPtr != NULL && added)
+        {
+            added = appendCell(cells, count, limit, y * width + (exitPtr - line));
+            exitPtr = memchr(exitPtr + 1, 'x', line + x1 - exitPtr - 1);
+        }
+    }
+
+    if (!added)
+    {
+        return false;
+    }
+
+    // a corner or an exit on a border can be added twice.
+    qsort(*cells + first, *count - first, sizeof(int), compareCells);
+
+    int unique = first;
+    for (int i = first; i < *count; ++i)
+    {
+        if (unique == first || (*cells)[unique - 1] != (*cells)[i])
+        {
+            (*cells)[unique++] = (*cells)[i];
+        }
+    }
+    *count = unique;
+
+    return true;
+}
+
+// This function sorts cells in ascending order.
+int compareCells(const void *a, const void *b)
+{
+    const int first = *(const int *)a;
+    const int second = *(const int *)b;
+
+    return (first > second) - (first < second);
+}
+
+// This function prepares the buffers of a search inside one cluster.
+// It returns false when error occurs.
+bool initHpaLocal(HpaLocal *local, const Maze *maze, const int clusterSize)
+{
+    local->clusterSize = clusterSize;
+    local->distance = malloc(sizeof(int) * clusterSize * clusterSize);
+    local->parent = malloc(sizeof(int) * clusterSize * clusterSize);
+    local->path = malloc(sizeof(int) * clusterSize * clusterSize);
+
+    if (local->distance == NULL || local->parent == NULL || local->path == NULL ||
+        !initBucketQueue(&local->queue, maze->maxCost + 1))
+    {
+        free(local->distance);
+        free(local->parent);
+        free(local->path);
+        local->distance = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// This function frees the buffers of a search inside one cluster.
+void freeHpaLocal(HpaLocal *local)
+{
+    free(local->distance);
+    free(local->parent);
+    free(local->path);
+    freeBucketQueue(&local->queue);
+}
+
+// This function uses Dial's algorithm from "source" without leaving its cluster.
+// It stops when "target" is reached, or searches the whole cluster if "target" is -1.
+// The distance of a cell (x, y) is "distance[(y - y0) * clusterSize + x - x0]".
+// It returns false when error occurs.
+bool searchCluster(const Maze *maze, HpaLocal *local, const int source, const int target)
+{
+    const int size = local->clusterSize;
+    const int width = maze->width;
+    const int x0 = (source % width) / size * size;
+    const int y0 = (source / width) / size * size;
+    const int x1 = (x0 + size < width) ? x0 + size : width;
+    const int y1 = (y0 + size < maze->height) ? y0 + size : maze->height;
+
+    memset(local->distance, -1, sizeof(int) * size * size);
+    clearBucketQueue(&local->queue);
+
+    const int sourceLocal = (source / width - y0) * size + source % width - x0;
+    local->distance[sourceLocal] = 0;
+    local->parent[sourceLocal] = -1;
+    if (!pushBucketQueue(&local->queue, 0, source))
+    {
+        return false;
+    }
+
+    uint64_t expanded = 0;
+    while (true)
+    {
+        int key;
+        const int current = popBucketQueue(&local->queue, &key);
+        if (current == -1 || current == target)
+        {
+            break;
+        }
+
+        // this cell has been reached by a cheaper path.
+        const int currentLocal = (current / width - y0) * size + current % width - x0;
+        if (key != local->distance[currentLocal])
+        {
+            continue;
+        }
+        expanded++;
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int x = neighbours[i] % width;
+            const int y = neighbours[i] / width;
+            if (x < x0 || x >= x1 || y < y0 || y >= y1)
+            {
+                continue;
+            }
+
+            const int next = (y - y0) * size + x - x0;
+            const int nextDistance = key + getCost(maze, neighbours[i]);
+
+            if (local->distance[next] == -1 || nextDistance < local->distance[next])
+            {
+                local->distance[next] = nextDistance;
+                local->parent[next] = currentLocal;
+                if (!pushBucketQueue(&local->queue, nextDistance, neighbours[i]))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    COUNT_EXPANDED(expanded);
+    return true;
+}
+
+// This function returns the distance of "cell" found by the last "searchCluster", or -1.
+// "cell" must be in the same cluster as the source.
+int getLocalDistance(const Maze *maze, const HpaLocal *local, const int cell)
+{
+    const int size = local->clusterSize;
+    const int x = cell % maze->width;
+    const int y = cell / maze->width;
+
+    return local->distance[(y % size) * size + x % size];
+}
+
+// This function builds the hierarchical index of a map.
+// It returns false when error occurs.
+bool buildHpaIndex(const Maze *maze, const int clusterSize, HpaIndex *index)
+{
+    memset(index, 0, sizeof(HpaIndex));
+    index->clusterSize = clusterSize;
+    index->clustersX = (maze->width + clusterSize - 1) / clusterSize;
+    index->clustersY = (maze->height + clusterSize - 1) / clusterSize;
+
+    const int clusterCount = index->clustersX * index->clustersY;
+    int nodeLimit = 0;
+    int edgeLimit = 0;
+    HpaLocal local;
+
+    index->firstNode = malloc(sizeof(int32_t) * (clusterCount + 1));
+    if (index->firstNode == NULL || !initHpaLocal(&local, maze, clusterSize))
+    {
+        free(index->firstNode);
+        return false;
+    }
+
+    // the nodes are grouped by cluster.
+    for (int cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        index->firstNode[cluster] = index->nodeCount;
+        if (!collectClusterNodes(maze, index, cluster, &index->nodes, &index->nodeCount, &nodeLimit))
+        {
+            freeHpaLocal(&local);
+            freeHpaIndex(index);
+            return false;
+        }
+    }
+    index->firstNode[clusterCount] = index->nodeCount;
+
+    index->firstEdge = malloc(sizeof(int32_t) * (index->nodeCount + 1));
+    if (index->firstEdge == NULL)
+    {
+        freeHpaLocal(&local);
+        freeHpaIndex(index);
+        return false;
+    }
+
+    // the edges are the distances inside a cluster and the steps between clusters.
+    bool failed = false;
+    for (int cluster = 0; cluster < clusterCount && !failed; ++cluster)
+    {
+        for (int node = index->firstNode[cluster]; node < index->firstNode[cluster + 1] && !failed; ++node)
+        {
+            const int cell = index->nodes[node];
+            index->firstEdge[node] = index->edgeCount;
+            failed = !searchCluster(maze, &local, cell, -1);
+
+            for (int other = index->firstNode[cluster]; other < index->firstNode[cluster + 1] && !failed; ++other)
+            {
+                const int cost = getLocalDistance(maze, &local, index->nodes[other]);
+                if (other != node && cost != -1)
+                {
+                    failed = !appendHpaEdge(index, &edgeLimit, other, cost);
+                }
+            }
+
+            int neighbours[4];
+            const int count = getNeighbours(maze, cell, neighbours);
+
+            for (int i = 0; i < count && !failed; ++i)
+            {
+                const int other = findHpaNode(maze, index, neighbours[i]);
+                if (other != -1 && getCluster(maze, index, neighbours[i]) != cluster)
+                {
+                    failed = !appendHpaEdge(index, &edgeLimit, other, getCost(maze, neighbours[i]));
+                }
+            }
+        }
+    }
+    index->firstEdge[index->nodeCount] = index->edgeCount;
+
+    freeHpaLocal(&local);
+
+    if (failed)
+    {
+        freeHpaIndex(index);
+        return false;
+    }
+
+    return true;
+}
+
+// This function adds an edge to the node which is being built.
+// It returns false when error occurs.
+bool appendHpaEdge(HpaIndex *index, int *limit, const int target, const int cost)
+{
+    // malloc more memory when reach the limit
+    if (index->edgeCount == *limit)
+    {
+        int newLimit = *limit == 0 ? EXIT_LIST_SIZE : *limit * 2;
+        HpaEdge *edges = realloc(index->edges, sizeof(HpaEdge) * newLimit);
+        if (edges == NULL)
+        {
+            return false;
+        }
+
+        index->edges = edges;
+        *limit = newLimit;
+    }
+
+    index->edges[index->edgeCount].target = target;
+    index->edges[index->edgeCount].cost = cost;
+    index->edgeCount++;
+
+    index->maxEdgeCost = (cost > index->maxEdgeCost) ? cost : index->maxEdgeCost;
+    return true;
+}
+
+// This function frees the hierarchical index.
+void freeHpaIndex(HpaIndex *index)
+{
+    if (index->mapping != NULL)
+    {
+        munmap(index->mapping, index->mappingSize);
+    }
+    else
+    {
+        free(index->nodes);
+        free(index->firstNode);
+        free(index->firstEdge);
+        free(index->edges);
+    }
+
+    index->mapping = NULL;
+    index->nodes = NULL;
+    index->firstNode = NULL;
+    index->firstEdge = NULL;
+    index->edges = NULL;
+}
+
+// This function reads the hierarchical index from "indexPath".
+// The file is mapped and used in place.
+// It returns false if there is no valid index for this map.
+bool loadHpaIndex(const char *indexPath, const Maze *maze, const int clusterSize, const uint64_t hash,
+                  HpaIndex *index)
+{
+    int fd = open(indexPath, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(HpaHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // check whether the index is built from the same map with the same clusters.
+    const HpaHeader *header = mapping;
+    const size_t clusterCount = (size_t)((maze->width + clusterSize - 1) / clusterSize) *
+                                ((maze->height + clusterSize - 1) / clusterSize);
+    const size_t size = sizeof(HpaHeader) +
+                        sizeof(int32_t) * ((size_t)header->nodeCount * 2 + clusterCount + 2) +
+                        sizeof(HpaEdge) * (size_t)header->edgeCount;
+
+    if (memcmp(header->magic, HPA_MAGIC, sizeof(HPA_MAGIC)) != 0 || header->hash != hash ||
+        header->width != maze->width || header->height != maze->height ||
+        header->clusterSize != clusterSize || header->nodeCount < 0 || header->edgeCount < 0 ||
+        (size_t)info.st_size != size)
+    {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    index->clusterSize = clusterSize;
+    index->clustersX = (maze->width + clusterSize - 1) / clusterSize;
+    index->clustersY = (maze->height + clusterSize - 1) / clusterSize;
+    index->nodeCount = header->nodeCount;
+    index->edgeCount = header->edgeCount;
+    index->maxEdgeCost = header->maxEdgeCost;
+    index->nodes = (int32_t *)((char *)mapping + sizeof(HpaHeader));
+    index->firstNode = index->nodes + index->nodeCount;
+    index->firstEdge = index->firstNode + clusterCount + 1;
+    index->edges = (HpaEdge *)(index->firstEdge + index->nodeCount + 1);
+    index->mapping = mapping;
+    index->mappingSize = info.st_size;
+    return true;
+}
+
+// This function saves the hierarchical index to "indexPath".
+// Nothing is saved when error occurs, the index is just built again next time.
+void saveHpaIndex(const char *indexPath, const Maze *maze, const HpaIndex *index, const uint64_t hash)
+{
+    // write a temporary file first, so a broken index is never read.
+    char *tmpPath = malloc(sizeof(char) * (strlen(indexPath) + 5));
+    if (tmpPath == NULL)
+    {
+        return;
+    }
+    strcpy(tmpPath, indexPath);
+    strcat(tmpPath, ".tmp");
+
+    FILE *fPtr = fopen(tmpPath, "wb");
+    if (fPtr == NULL)
+    {
+        free(tmpPath);
+        return;
+    }
+
+    HpaHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HPA_MAGIC, sizeof(HPA_MAGIC));
+    header.hash = hash;
+    header.width = maze->width;
+    header.height = maze->height;
+    header.clusterSize = index->clusterSize;
+    header.nodeCount = index->nodeCount;
+    header.edgeCount = index->edgeCount;
+    header.maxEdgeCost = index->maxEdgeCost;
+
+    const size_t clusterCount = (size_t)index->clustersX * index->clustersY;
+    bool written = fwrite(&header, sizeof(header), 1, fPtr) == 1 &&
+                   fwrite(index->nodes, sizeof(int32_t), index->nodeCount, fPtr) == (size_t)index->nodeCount &&
+                   fwrite(index->firstNode, sizeof(int32_t), clusterCount + 1, fPtr) == clusterCount + 1 &&
+                   fwrite(index->firstEdge, sizeof(int32_t), index->nodeCount + 1, fPtr) == (size_t)index->nodeCount + 1 &&
+                   fwrite(index->edges, sizeof(HpaEdge), index->edgeCount, fPtr) == (size_t)index->edgeCount;
+
+    if (fclose(fPtr) != 0 || !written || rename(tmpPath, indexPath) != 0)
+    {
+        remove(tmpPath);
+    }
+
+    free(tmpPath);
+}
+
+// This function gets the hierarchical index of the map.
+// With "--cache", it's read from the index file next to the map, or saved there after it's built.
+// It returns false when error occurs.
+bool getHpaIndex(const Maze *maze, const Options *options, HpaIndex *index)
+{
+    memset(index, 0, sizeof(HpaIndex));
+
+    // only regular files can have an index file next to them.
+    if (!options->useCache || !maze->regular)
+    {
+        return buildHpaIndex(maze, options->clusterSize, index);
+    }
+
+    char *indexPath = getCachePath(options->path, HPA_SUFFIX);
+    if (indexPath == NULL)
+    {
+        return false;
+    }
+
+    const uint64_t hash = hashMaze(maze);
+    if (loadHpaIndex(indexPath, maze, options->clusterSize, hash, index))
+    {
+        free(indexPath);
+        return true;
+    }
+
+    if (!buildHpaIndex(maze, options->clusterSize, index))
+    {
+        free(indexPath);
+        return false;
+    }
+
+    saveHpaIndex(indexPath, maze, index, hash);
+    free(indexPath);
+    return true;
+}
+
+// This function prepares the buffers used by HPA* queries.
+// The buffers only depend on the size of the abstract graph and of a cluster.
+// It returns false when error occurs.
+bool initHpaSearch(HpaSearch *search, const Maze *maze, const HpaIndex *index)
+{
+    search->index = index;
+    search->touchedCount = 0;
+    search->distance = malloc(sizeof(int) * (index->nodeCount + 1));
+    search->parent = malloc(sizeof(int) * (index->nodeCount + 1));
+    search->touched = malloc(sizeof(int) * (index->nodeCount + 1));
+    search->route = malloc(sizeof(int) * (index->nodeCount + 1));
+
+    // a new key is the popped key plus the cost of the edge and the change of the heuristic,
+    // which is never more than the cost, so the keys in the queue span at most twice the largest edge.
+    if (search->distance == NULL || search->parent == NULL || search->touched == NULL || search->route == NULL ||
+        !initBucketQueue(&search->queue, 2 * index->maxEdgeCost + 1))
+    {
+        free(search->distance);
+        free(search->parent);
+        free(search->touched);
+        free(search->route);
+        return false;
+    }
+
+    if (!initHpaLocal(&search->local, maze, index->clusterSize))
+    {
+        freeHpaSearch(search);
+        return false;
+    }
+
+    memset(search->distance, -1, sizeof(int) * (index->nodeCount + 1));
+    return true;
+}
+
+// This function frees the buffers used by HPA* queries.
+void freeHpaSearch(HpaSearch *search)
+{
+    free(search->distance);
+    free(search->parent);
+    free(search->touched);
+    free(search->route);
+    freeBucketQueue(&search->queue);
+
+    if (search->local.distance != NULL)
+    {
+        freeHpaLocal(&search->local);
+    }
+}
+
+// This function prints the path from "cell" to "target" in the same cluster, without "cell".
+// It returns false when error occurs.
+bool printClusterPath(const Maze *maze, HpaLocal *local, const int cell, const int target, PathWriter *writer)
+{
+    if (!searchCluster(maze, local, cell, target))
+    {
+        return false;
+    }
+
+    const int size = local->clusterSize;
+    const int x0 = (cell % maze->width) / size * size;
+    const int y0 = (cell / maze->width) / size * size;
+    const int targetX = target % maze->width;
+    const int targetY = target / maze->width;
+
+    // follow the parents back from the target.
+    int length = 0;
+    int current = (targetY - y0) * size + targetX - x0;
+    while (local->parent[current] != -1)
+    {
+        local->path[length++] = current;
+        current = local->parent[current];
+    }
+
+    for (int i = length - 1; i >= 0; --i)
+    {
+        writePathCell(writer, x0 + local->path[i] % size, y0 + local->path[i] / size);
+    }
+    STAT_ADD(pathLength, length);
+
+    return true;
+}
+
+// This function uses A* on the abstract graph from "start" and prints the refined path.
+// The path is near-shortest, it can be longer than the BFS path since it only crosses the clusters at their entrances.
+// Only the start cluster and the clusters on the abstract path are searched on the map.
+// It returns false when error occurs.
+bool printHpaPath(const Maze *maze, HpaSearch *search, const int start, PathWriter *writer)
+{
+    const HpaIndex *index = search->index;
+
+    // only the nodes reached by the last query are reset.
+    for (int i = 0; i < search->touchedCount; ++i)
+    {
+        search->distance[search->touched[i]] = -1;
+    }
+    search->touchedCount = 0;
+    clearBucketQueue(&search->queue);
+
+    writePathCell(writer, start % maze->width, start / maze->width);
+    STAT_ADD(pathLength, 1);
+    if (isExit(maze, start))
+    {
+        endPath(writer);
+        return true;
+    }
+
+    // the start is connected to the nodes of its cluster.
+    if (!searchCluster(maze, &search->local, start, -1))
+    {
+        return false;
+    }
+
+    // the start can be further from the nodes of its cluster than the largest edge,
+    // the queue is made larger for this query then.
+    const int cluster = getCluster(maze, index, start);
+    int largest = index->maxEdgeCost;
+    for (int node = index->firstNode[cluster]; node < index->firstNode[cluster + 1]; ++node)
+    {
+        const int cost = getLocalDistance(maze, &search->local, index->nodes[node]);
+        largest = (cost > largest) ? cost : largest;
+    }
+    if (2 * largest + 1 > search->queue.count)
+    {
+        freeBucketQueue(&search->queue);
+        if (!initBucketQueue(&search->queue, 2 * largest + 1))
+        {
+            return false;
+        }
+    }
+
+    for (int node = index->firstNode[cluster]; node < index->firstNode[cluster + 1]; ++node)
+    {
+        const int cost = getLocalDistance(maze, &search->local, index->nodes[node]);
+        if (cost != -1)
+        {
+            search->distance[node] = cost;
+            search->parent[node] = -1;
+            search->touched[search->touchedCount++] = node;
+            if (!pushBucketQueue(&search->queue, cost + getHeuristic(maze, index->nodes[node]), node))
+            {
+                return false;
+            }
+        }
+    }
+
+    int goal = -1;
+    uint64_t expanded = 0;
+    while (true)
+    {
+        int key;
+        const int node = popBucketQueue(&search->queue, &key);
+        if (node == -1)
+        {
+            break;
+        }
+
+        // this node has been reached by a cheaper path.
+        if (key != search->distance[node] + getHeuristic(maze, index->nodes[node]))
+        {
+            continue;
+        }
+        expanded++;
+
+        // the first exit popped is the cheapest one.
+        if (isExit(maze, index->nodes[node]))
+        {
+            goal = node;
+            break;
+        }
+
+        for (int i = index->firstEdge[node]; i < index->firstEdge[node + 1]; ++i)
+        {
+            const int next = index->edges[i].target;
+            const int nextDistance = search->distance[node] + index->edges[i].cost;
+
+            if (search->distance[next] == -1 || nextDistance < search->distance[next])
+            {
+                if (search->distance[next] == -1)
+                {
+                    search->touched[search->touchedCount++] = next;
+                }
+
+                search->distance[next] = nextDistance;
+                search->parent[next] = node;
+                if (!pushBucketQueue(&search->queue, nextDistance + getHeuristic(maze, index->nodes[next]), next))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    COUNT_EXPANDED(expanded);
+    if (goal == -1)
+    {
+        endPath(writer);
+        puts("No escape possible.");
+        return true;
+    }
+
+    // the abstract path is saved from the exit to the start.
+    STAT_PHASE(PHASE_PATH);
+    int length = 0;
+    for (int node = goal; node != -1; node = search->parent[node])
+    {
+        search->route[length++] = node;
+    }
+
+    // each step between two clusters is one move, the others are refined inside their cluster.
+    STAT_PHASE(PHASE_OUTPUT);
+    int cell = start;
+    for (int i = length - 1; i >= 0; --i)
+    {
+        const int next = index->nodes[search->route[i]];
+
+        if (getCluster(maze, index, next) != getCluster(maze, index, cell))
+        {
+            writePathCell(writer, next % maze->width, next / maze->width);
+            STAT_ADD(pathLength, 1);
+        }
+        else if (next != cell && !printClusterPath(maze, &search->local, cell, next, writer))
+        {
+            return false;
+        }
+
+        cell = next;
+    }
+
+    endPath(writer);
+    return true;
+}
+
+// This function returns the direction of the move from "cell" to its neighbour "next".
+int getDirection(const Maze *maze, const int cell, const int next)
+{
+    if (next == cell - maze->width)
+    {
+        return UP;
+    }
+    else if (next == cell + maze->width)
+    {
+        return DOWN;
+    }
+
+    return (next == cell - 1) ? LEFT : RIGHT;
+}
+
+// This function prepares the distance field of a map whose walls change, then builds it from the exits.
+// It returns false when error occurs.
+bool initDynamicField(const Maze *maze, DynamicField *dynamic)
+{
+    const int cells = maze->width * maze->height;
+
+    memset(dynamic, 0, sizeof(DynamicField));
+    dynamic->field.width = maze->width;
+    dynamic->field.height = maze->height;
+    dynamic->field.directions = malloc(sizeof(unsigned char) * (cells / 2 + 1));
+    dynamic->distance = malloc(sizeof(int) * (cells + 1));
+
+    if (dynamic->field.directions == NULL || dynamic->distance == NULL ||
+        !initBucketQueue(&dynamic->queue, maze->maxCost + 1))
+    {
+        free(dynamic->field.directions);
+        free(dynamic->distance);
+        return false;
+    }
+
+    // every cell starts as unreachable, and the exits are the first seeds.
+    memset(dynamic->field.directions, FIELD_NONE | (FIELD_NONE << 4), sizeof(unsigned char) * (cells / 2 + 1));
+    memset(dynamic->distance, -1, sizeof(int) * (cells + 1));
+
+    for (int i = 0; i < maze->exitCount; ++i)
+    {
+        dynamic->distance[maze->exits[i]] = 0;
+        setFieldDirection(&dynamic->field, maze->exits[i], FIELD_EXIT);
+        if (!appendSeed(dynamic, 0, maze->exits[i]))
+        {
+            freeDynamicField(dynamic);
+            return false;
+        }
+    }
+
+    if (!propagateDynamicField(maze, dynamic))
+    {
+        freeDynamicField(dynamic);
+        return false;
+    }
+
+    return true;
+}
+
+// This function frees the distance field of a map whose walls change.
+void freeDynamicField(DynamicField *dynamic)
+{
+    free(dynamic->field.directions);
+    free(dynamic->distance);
+    free(dynamic->repair);
+    free(dynamic->seeds);
+    freeBucketQueue(&dynamic->queue);
+
+    dynamic->field.directions = NULL;
+    dynamic->distance = NULL;
+    dynamic->repair = NULL;
+    dynamic->seeds = NULL;
+}
+
+// This function adds a cell with a known distance to the seeds of the next propagation.
+// It returns false when error occurs.
+bool appendSeed(DynamicField *dynamic, const int distance, const int cell)
+{
+    // malloc more memory when reach the limit
+    if (dynamic->seedCount == dynamic->seedLimit)
+    {
+        int limit = dynamic->seedLimit == 0 ? EXIT_LIST_SIZE : dynamic->seedLimit * 2;
+        uint64_t *seeds = realloc(dynamic->seeds, sizeof(uint64_t) * limit);
+        if (seeds == NULL)
+        {
+            return false;
+        }
+
+        dynamic->seeds = seeds;
+        dynamic->seedLimit = limit;
+    }
+
+    // the distance is in the high bits, so the seeds are sorted by distance.
+    dynamic->seeds[dynamic->seedCount++] = ((uint64_t)distance << 32) | (uint32_t)cell;
+    return true;
+}
+
+// This function sorts the seeds in ascending order.
+int compareSeeds(const void *a, const void *b)
+{
+    const uint64_t first = *(const uint64_t *)a;
+    const uint64_t second = *(const uint64_t *)b;
+
+    return (first > second) - (first < second);
+}
+
+// This function uses Dial's algorithm from the seeds to lower the distances around them.
+// The seeds join the queue in order, so all the keys in the queue stay in its ring.
+// It returns false when error occurs.
+bool propagateDynamicField(const Maze *maze, DynamicField *dynamic)
+{
+    qsort(dynamic->seeds, dynamic->seedCount, sizeof(uint64_t), compareSeeds);
+    clearBucketQueue(&dynamic->queue);
+
+    int seedIndex = 0;
+    bool failed = false;
+
+    while (!failed)
+    {
+        const int lowest = peekBucketQueue(&dynamic->queue);
+        if (seedIndex < dynamic->seedCount && (lowest == -1 || (int)(dynamic->seeds[seedIndex] >> 32) <= lowest))
+        {
+            const int key = (int)(dynamic->seeds[seedIndex] >> 32);
+            const int cell = (int)(uint32_t)dynamic->seeds[seedIndex];
+            seedIndex++;
+
+            // the seed may have been lowered already.
+            if (key == dynamic->distance[cell])
+            {
+                failed = !pushBucketQueue(&dynamic->queue, key, cell);
+            }
+            continue;
+        }
+
+        int key;
+        const int current = popBucketQueue(&dynamic->queue, &key);
+        if (current == -1)
+        {
+            break;
+        }
+
+        // this cell has been reached by a cheaper path.
+        if (key != dynamic->distance[current])
+        {
+            continue;
+        }
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, current, neighbours);
+
+        for (int i = 0; i < count && !failed; ++i)
+        {
+            const int next = neighbours[i];
+            const int nextDistance = key + getCost(maze, next);
+
+            if (dynamic->distance[next] < 0 || nextDistance < dynamic->distance[next])
+            {
+                dynamic->distance[next] = nextDistance;
+                setFieldDirection(&dynamic->field, next, getDirection(maze, next, current));
+                failed = !pushBucketQueue(&dynamic->queue, nextDistance, next);
+            }
+        }
+    }
+
+    dynamic->seedCount = 0;
+    return !failed;
+}
+
+// This function repairs the distance field after the cells in "changed" are toggled.
+// The cells whose path went through a new wall are cut off with all the cells behind them,
+// then they and the new floors are seeded from their neighbours and the distances are propagated.
+// Only the cells whose distance changes are touched.
+// It returns false when error occurs.
+bool repairDynamicField(const Maze *maze, DynamicField *dynamic, const int *changed, const int changedCount)
+{
+    const int offset[4] = {-maze->width, maze->width, -1, 1};
+    int repairCount = 0;
+
+    // -2 marks the cells which are being repaired.
+    for (int i = 0; i < changedCount; ++i)
+    {
+        const int cell = changed[i];
+        dynamic->distance[cell] = (getCost(maze, cell) == 0) ? -1 : -2;
+        setFieldDirection(&dynamic->field, cell, FIELD_NONE);
+
+        if (!appendCell(&dynamic->repair, &repairCount, &dynamic->repairLimit, cell))
+        {
+            return false;
+        }
+    }
+
+    // the cells which moved through a repaired cell are repaired too.
+    for (int i = 0; i < repairCount; ++i)
+    {
+        int neighbours[4];
+        const int count = getNeighbours(maze, dynamic->repair[i], neighbours);
+
+        for (int j = 0; j < count; ++j)
+        {
+            const int next = neighbours[j];
+            const int direction = getFieldDirection(&dynamic->field, next);
+
+            if (dynamic->distance[next] >= 0 && direction <= RIGHT && next + offset[direction] == dynamic->repair[i])
+            {
+                dynamic->distance[next] = -2;
+                setFieldDirection(&dynamic->field, next, FIELD_NONE);
+
+                if (!appendCell(&dynamic->repair, &repairCount, &dynamic->repairLimit, next))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // each repaired cell starts from its best neighbour which is still valid.
+    for (int i = 0; i < repairCount; ++i)
+    {
+        const int cell = dynamic->repair[i];
+        if (dynamic->distance[cell] != -2)
+        {
+            continue;
+        }
+
+        int neighbours[4];
+        const int count = getNeighbours(maze, cell, neighbours);
+        int best = -1;
+
+        for (int j = 0; j < count; ++j)
+        {
+            if (dynamic->distance[neighbours[j]] >= 0 &&
+                (best == -1 || dynamic->distance[neighbours[j]] < dynamic->distance[best]))
+            {
+                best = neighbours[j];
+            }
+        }
+
+        dynamic->distance[cell] = -1;
+        if (best != -1)
+        {
+            dynamic->distance[cell] = dynamic->distance[best] + getCost(maze, cell);
+            setFieldDirection(&dynamic->field, cell, getDirection(maze, cell, best));
+
+            if (!appendSeed(dynamic, dynamic->distance[cell], cell))
+            {
+                return false;
+            }
+        }
+    }
+
+    // the distances of the repaired cells are final only after the propagation.
+    for (int i = 0; i < repairCount; ++i)
+    {
+        if (dynamic->distance[dynamic->repair[i]] == -2)
+        {
+            dynamic->distance[dynamic->repair[i]] = -1;
+        }
+    }
+
+    return propagateDynamicField(maze, dynamic);
+}
+
+// This function prints the path from the start, or why there is no path.
+void printDynamicPath(const Maze *maze, const DynamicField *dynamic, const int x, const int y, PathWriter *writer)
+{
+    if (x >= maze->width || y >= maze->height || *(maze->cells + y * maze->stride + x) == '#')
+    {
+        puts("Invalid starting location!");
+    }
+    else
+    {
+        printFieldPath(maze, &dynamic->field, x, y, writer);
+    }
+}
+
+// This function reads batches of toggles from "input", and prints the path after each batch.
+// A toggle is "x y" or "x,y", it turns a wall into a floor or a floor into a wall.
+// A batch ends with an empty line or at the end of the input.
+// The path is printed once before the first batch, and each path ends with an empty line.
+// It returns false when error occurs.
+bool runDynamic(Maze *maze, DynamicField *dynamic, FILE *input, const int x, const int y, PathWriter *writer)
+{
+    char *line = NULL;
+    size_t limit = 0;
+    int *changed = NULL;
+    int changedCount = 0;
+    int changedLimit = 0;
+    bool pending = false;
+    bool failed = false;
+
+    printDynamicPath(maze, dynamic, x, y, writer);
+    putchar('\n');
+
+    while (!failed)
+    {
+        const bool ended = getline(&line, &limit, input) == -1;
+
+        // an empty line or the end of the input finishes the batch.
+        if (ended || strspn(line, " \t\r\n") == strlen(line))
+        {
+            if (pending)
+            {
+                failed = changedCount > 0 && !repairDynamicField(maze, dynamic, changed, changedCount);
+                changedCount = 0;
+                pending = false;
+
+                printDynamicPath(maze, dynamic, x, y, writer);
+                putchar('\n');
+            }
+
+            if (ended)
+            {
+                break;
+            }
+            continue;
+        }
+
+        int toggleX, toggleY;
+        pending = true;
+        if (!readQuery(line, &toggleX, &toggleY) || toggleX >= maze->width || toggleY >= maze->height)
+        {
+            puts("Invalid toggle location!");
+            continue;
+        }
+
+        // only walls and floors can be toggled, the exits and the terrain stay.
+        char *cellPtr = maze->data + (maze->cells - maze->data) + toggleY * maze->stride + toggleX;
+        if (*cellPtr != '#' && *cellPtr != '.')
+        {
+            puts("Invalid toggle location!");
+            continue;
+        }
+
+        *cellPtr = (*cellPtr == '#') ? '.' : '#';
+        failed = !appendCell(&changed, &changedCount, &changedLimit, toggleY * maze->width + toggleX);
+    }
+
+    free(line);
+    free(changed);
+    return !failed;
+}
+
+// This function solves the maze from the starting location with the selected solver.
+// If the route exists, it will be printed in these functions.
+void solveMaze(Maze *maze, const Options *options, PathWriter *writer)
+{
+    if (options->components)
+    {
+        if (checkStartingLocation(maze, options->x, options->y))
+        {
+            return;
+        }
+
+        // the start can't escape if there is no exit in its component.
+        Components components;
+        if (!getComponents(maze, options, &components))
+        {
+            freeMaze(maze);
+            errorHandle(5);
+        }
+
+        const int label = components.labels[options->y * maze->width + options->x];
+        const bool reachable = components.exits[label];
+        freeComponents(&components);
+
+        if (!reachable)
+        {
+            printf("%d,%d\n", options->x, options->y);
+            puts("No escape possible.");
+            return;
+        }
+    }
+
+    if (options->algorithm == ALGO_HPA)
+    {
+        // the path is found in the hierarchical index.
+        if (!checkStartingLocation(maze, options->x, options->y))
+        {
+            HpaIndex index;
+            HpaSearch search;
+
+            bool ready = getHpaIndex(maze, options, &index);
+            if (ready && !initHpaSearch(&search, maze, &index))
+            {
+                freeHpaIndex(&index);
+                ready = false;
+            }
+
+            bool printed = ready && printHpaPath(maze, &search, options->y * maze->width + options->x, writer);
+            if (ready)
+            {
+                freeHpaSearch(&search);
+                freeHpaIndex(&index);
+            }
+
+            if (!printed)
+            {
+                freeMaze(maze);
+                errorHandle(5);
+            }
+        }
+    }
+    else if (options->useCache)
+    {
+        // the path is read from the cached direction field.
+        if (!checkStartingLocation(maze, options->x, options->y))
+        {
+            Field field;
+            if (!getField(maze, options, &field))
+            {
+                freeMaze(maze);
+                errorHandle(5);
+            }
+
+            printFieldPath(maze, &field, options->x, options->y, writer);
+            freeField(&field);
+        }
+    }
+    else if (maze->weighted)
+    {
+        // the maps with terrain costs always use the weighted search.
+        getShortestPathWeighted(maze, options->x, options->y, writer);
+    }
+    else
+    {
+        switch (options->algorithm)
+        {
+            case ALGO_BFS:
+                if (options->layout == LAYOUT_BLOCKED)
+                {
+                    getShortestPathBlocked(maze, options->x, options->y, writer);
+                }
+                else
+                {
+                    getShortestPath(maze, options->x, options->y, writer);
+                }
+                break;
+
+            case ALGO_BIDIRECTIONAL:
+                getShortestPathBidirectional(maze, options->x, options->y, writer);
+                break;
+
+            case ALGO_ASTAR:
+                getShortestPathAStar(maze, options->x, options->y, writer);
+                break;
+
+            case ALGO_JPS:
+                getShortestPathJPS(maze, options->x, options->y, writer);
+                break;
+
+            case ALGO_PARALLEL:
+                getShortestPathParallel(maze, options->x, options->y, options->threads, writer);
+                break;
+
+            case ALGO_DOBFS:
+                getShortestPathDirectionOptimizing(maze, options->x, options->y, writer);
+                break;
+        }
+    }
+}
+
+// This function returns the time of a monotonic clock in seconds.
+double getTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// This function prints one line of benchmark results to stderr.
+// The columns are algorithm, width, height, load time, solve time, peak RSS,
+// the cells expanded by the solver and the expanded cells per second.
+void printBench(const char *algorithm, const uint64_t width, const uint64_t height, const double loadTime, const double solveTime)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(stderr, "%s,%llu,%llu,%.3f,%.3f,%ld,%llu,%.0f\n", algorithm, (unsigned long long)width,
+            (unsigned long long)height, loadTime * 1000, solveTime * 1000, usage.ru_maxrss,
+            (unsigned long long)expandedCells, (solveTime > 0) ? expandedCells / solveTime : 0);
+}
+
+// This function prints the counters and the phase times of "--stats" to stderr.
+// They are only counted when the program is built with "-DDUNGEON_STATS".
+void printStats(void)
+{
+#ifdef DUNGEON_STATS
+    const char *names[] = {"parse", "validate", "solve", "path", "output"};
+
+    // the last phase ends now.
+    STAT_PHASE(PHASE_COUNT);
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        fprintf(stderr, "%s_ms %.3f\n", names[i], stats.phaseTimes[i] * 1000);
+    }
+
+    fprintf(stderr, "enqueued %llu\n", atomic_load(&stats.enqueued));
+    fprintf(stderr, "expanded %llu\n", (unsigned long long)expandedCells);
+    fprintf(stderr, "max_frontier %llu\n", atomic_load(&stats.maxFrontier));
+    fprintf(stderr, "bytes_allocated %llu\n", atomic_load(&stats.bytes));
+    fprintf(stderr, "path_length %llu\n", atomic_load(&stats.pathLength));
+    fprintf(stderr, "bottom_up_levels %llu\n", atomic_load(&stats.bottomUpLevels));
+#else
+    fputs("No statistics, build with -DDUNGEON_STATS to use \"--stats\".\n", stderr);
+#endif
+}
+
+// This function prints the path which ends at the entry "index" of the BFS queue.
+// The parents are followed back to the start, and the path is rebuilt into one buffer of cell IDs.
+// It calls "errorHandle" fucntion when error occurs.
+void printShortestPath(Maze *maze, void *queue, size_t index, const bool wide, PathWriter *writer)
+{
+    STAT_PHASE(PHASE_PATH);
+
+    size_t length = 1;
+    for (size_t current = index; current != 0; current = getCellId(queue, current * 2 + 1, wide))
+    {
+        length++;
+    }
+
+    void *path = malloc((wide ? sizeof(uint64_t) : sizeof(uint32_t)) * length);
+    if (path == NULL)
+    {
+        free(queue);
+        freeMaze(maze);
+        errorHandle(5);
+    }
+
+    for (size_t i = length; i > 0; --i)
+    {
+        setCellId(path, i - 1, getCellId(queue, index * 2, wide), wide);
+        index = getCellId(queue, index * 2 + 1, wide);
+    }
+
+    // print the path from the start.
+    STAT_PHASE(PHASE_OUTPUT);
+    STAT_ADD(pathLength, length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        const size_t cell = getCellId(path, i, wide);
+        writePathCell(writer, cell % maze->stride, cell / maze->stride);
+    }
+    endPath(writer);
+    free(path);
+}
+
+// This function returns the root of the set of "cell".
+// The path is halved on the way, and every link points to a smaller cell.
+int findRoot(int32_t *parent, int cell)
+{
+    while (parent[cell] != cell)
+    {
+        parent[cell] = parent[parent[cell]];
+        cell = parent[cell];
+    }
+
+    return cell;
+}
+
+// This function joins the sets of two cells, the smaller root becomes the root of both.
+void unionCells(int32_t *parent, const int first, const int second)
+{
+    const int firstRoot = findRoot(parent, first);
+    const int secondRoot = findRoot(parent, second);
+
+    if (firstRoot < secondRoot)
+    {
+        parent[secondRoot] = firstRoot;
+    }
+    else if (secondRoot < firstRoot)
+    {
+        parent[firstRoot] = secondRoot;
+    }
+}
+
+// This function joins each open cell of a band with the open cells on its left and above.
+// The links never leave the band, so the bands can be labelled at the same time.
+void *labelBand(void *arg)
+{
+    ComponentBand *band = arg;
+    const Maze *maze = band->maze;
+    int32_t *labels = band->labels;
+
+    for (int row = band->firstRow; row < band->lastRow; ++row)
+    {
+        const char *line = maze->cells + row * maze->stride;
+
+        for (int col = 0; col < maze->width; ++col)
+        {
+            const int cell = row * maze->width + col;
+            if (line[col] == '#')
+            {
+                labels[cell] = -1;
+                continue;
+            }
+
+            labels[cell] = cell;
+            if (col > 0 && labels[cell - 1] != -1)
+            {
+                unionCells(labels, cell - 1, cell);
+            }
+            if (row > band->firstRow && labels[cell - maze->width] != -1)
+            {
+                unionCells(labels, cell - maze->width, cell);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// This function labels the connected components of the open cells with union-find.
+// The rows are split into one band for each thread, then the bands are joined at their edges.
+// It returns false when it's unable to allocate memory.
+bool buildComponents(const Maze *maze, const int threadCount, Components *components)
+{
+    const int cells = maze->width * maze->height;
+    const int bandCount = (threadCount < maze->height) ? threadCount : (maze->height > 0 ? maze->height : 1);
+
+    components->mapping = NULL;
+    components->exits = NULL;
+    components->labels = malloc(sizeof(int32_t) * (cells > 0 ? cells : 1));
+    ComponentBand *bands = malloc(sizeof(ComponentBand) * bandCount);
+    pthread_t *threads = malloc(sizeof(pthread_t) * bandCount);
+    if (components->labels == NULL || bands == NULL || threads == NULL)
+    {
+        free(components->labels);
+        free(bands);
+        free(threads);
+        return false;
+    }
+
+    for (int i = 0; i < bandCount; ++i)
+    {
+        bands[i].maze = maze;
+        bands[i].labels = components->labels;
+        bands[i].firstRow = (int)((long)maze->height * i / bandCount);
+        bands[i].lastRow = (int)((long)maze->height * (i + 1) / bandCount);
+    }
+
+    // the first band is labelled by this thread.
+    // If some threads can't be created, their bands are also labelled by this thread.
+    int started = 1;
+    for (; started < bandCount; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, labelBand, &bands[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    labelBand(&bands[0]);
+    for (int i = 1; i < bandCount; ++i)
+    {
+        if (i < started)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            labelBand(&bands[i]);
+        }
+    }
+
+    // join the first row of each band with the last row of the band above.
+    for (int i = 1; i < bandCount; ++i)
+    {
+        const int row = bands[i].firstRow;
+        for (int col = 0; col < maze->width; ++col)
+        {
+            const int cell = row * maze->width + col;
+            if (components->labels[cell] != -1 && components->labels[cell - maze->width] != -1)
+            {
+                unionCells(components->labels, cell - maze->width, cell);
+            }
+        }
+    }
+    free(bands);
+    free(threads);
+
+    // every link points to a smaller cell, which already holds its label.
+    int count = 0;
+    int32_t *labels = components->labels;
+    for (int cell = 0; cell < cells; ++cell)
+    {
+        if (labels[cell] != -1)
+        {
+            labels[cell] = (labels[cell] == cell) ? count++ : labels[labels[cell]];
+        }
+    }
+
+    components->count = count;
+    components->exits = calloc(count > 0 ? count : 1, sizeof(unsigned char));
+    if (components->exits == NULL)
+    {
+        free(components->labels);
+        return false;
+    }
+
+    for (int i = 0; i < maze->exitCount; ++i)
+    {
+        components->exits[labels[maze->exits[i]]] = 1;
+    }
+
+    return true;
+}
+
+// This function free the memory used by the component labels.
+void freeComponents(Components *components)
+{
+    if (components->mapping != NULL)
+    {
+        munmap(components->mapping, components->mappingSize);
+    }
+    else
+    {
+        free(components->labels);
+        free(components->exits);
+    }
+
+    components->labels = NULL;
+    components->exits = NULL;
+    components->mapping = NULL;
+}
+
+// This function maps the component labels saved at "cachePath".
+// It returns false if the file doesn't exist or is not built from this map.
+bool loadComponentCache(const char *cachePath, const Maze *maze, const uint64_t hash, Components *components)
+{
+    int fd = open(cachePath, O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // the labels of all the cells are followed by one byte for each component.
+    const CacheHeader *header = mapping;
+    const size_t labelSize = sizeof(int32_t) * maze->width * maze->height;
+    if (memcmp(header->magic, COMPONENT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->hash != hash || header->width != maze->width || header->height != maze->height ||
+        header->size > INT_MAX || (size_t)info.st_size != sizeof(CacheHeader) + labelSize + header->size)
+    {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    components->labels = (int32_t *)((char *)mapping + sizeof(CacheHeader));
+    components->exits = (unsigned char *)mapping + sizeof(CacheHeader) + labelSize;
+    components->count = (int)header->size;
+    components->mapping = mapping;
+    components->mappingSize = info.st_size;
+    return true;
+}
+
+// This function saves the component labels at "cachePath".
+// The cache is only an optimization, so errors are ignored.
+void saveComponentCache(const char *cachePath, const Maze *maze, const Components *components, const uint64_t hash)
+{
+    // write a temporary file first, so a broken cache is never read.
+    char *tmpPath = malloc(sizeof(char) * (strlen(cachePath) + 5));
+    if (tmpPath == NULL)
+    {
+        return;
+    }
+    strcpy(tmpPath, cachePath);
+    strcat(tmpPath, ".tmp");
+
+    FILE *fPtr = fopen(tmpPath, "wb");
+    if (fPtr == NULL)
+    {
+        free(tmpPath);
+        return;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COMPONENT_MAGIC, sizeof(header.magic));
+    header.hash = hash;
+    header.width = maze->width;
+    header.height = maze->height;
+    header.size = components->count;
+
+    const size_t cells = (size_t)maze->width * maze->height;
+    bool written = fwrite(&header, sizeof(header), 1, fPtr) == 1 &&
+                   fwrite(components->labels, sizeof(int32_t), cells, fPtr) == cells &&
+                   fwrite(components->exits, sizeof(unsigned char), header.size, fPtr) == header.size;
+
+    if (fclose(fPtr) != 0 || !written || rename(tmpPath, cachePath) != 0)
+    {
+        remove(tmpPath);
+    }
+
+    free(tmpPath);
+}
+
+// This function gets the component labels of the maze.
+// With "--cache" they are read from the cache file next to the map, or saved there after labelling.
+// It returns false when it's unable to allocate memory.
+bool getComponents(const Maze *maze, const Options *options, Components *components)
+{
+    // only regular files can have a cache file next to them.
+    if (!options->useCache || !maze->regular)
+    {
+        return buildComponents(maze, options->threads, components);
+    }
+
+    char *cachePath = getCachePath(options->path, COMPONENT_SUFFIX);
+    if (cachePath == NULL)
+    {
+        return false;
+    }
+
+    const uint64_t hash = hashMaze(maze);
+    if (loadComponentCache(cachePath, maze, hash, components))
+    {
+        free(cachePath);
+        return true;
+    }
+
+    if (!buildComponents(maze, options->threads, components))
+    {
+        free(cachePath);
+        return false;
+    }
+
+    saveComponentCache(cachePath, maze, components, hash);
+    free(cachePath);
+    return true;
+}
+
+// This function loads the maps of the daemon and answers the queries with a pool of workers.
+// Each query is a line "map x y", from stdin or from the clients of the socket "daemonPath".
+// It calls "errorHandle" fucntion when error occurs.
+void runDaemon(const int argc, char const *argv[], const Options *options)
+{
+    Daemon daemon;
+    daemon.compact = options->compact;
+    daemon.mapCount = 0;
+    daemon.jobHead = 0;
+    daemon.jobCount = 0;
+    daemon.closed = false;
+    daemon.nextSequence = 0;
+    daemon.clients = NULL;
+    daemon.clientCount = 0;
+    daemon.clientLimit = 0;
+    daemon.wakeFds[0] = daemon.wakeFds[1] = -1;
+
+    // every argument which is not an option is a map, "name=path" gives it a name.
+    daemon.maps = malloc(sizeof(DaemonMap) * argc);
+    if (daemon.maps == NULL)
+    {
+        errorHandle(5);
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            continue;
+        }
+
+        DaemonMap *map = &daemon.maps[daemon.mapCount];
+        const char *separator = strchr(argv[i], '=');
+        const char *path = (separator != NULL) ? separator + 1 : argv[i];
+        map->name = argv[i];
+        map->nameLength = (separator != NULL) ? (size_t)(separator - argv[i]) : strlen(argv[i]);
+
+        // the cache file is found next to each map.
+        Options mapOptions = *options;
+        mapOptions.path = path;
+        getMaze(path, &map->maze);
+        if (!fitsCellIds(&mapOptions, &map->maze))
+        {
+            freeMaze(&map->maze);
+            freeDaemon(&daemon);
+            errorHandle(9);
+        }
+        if (!getField(&map->maze, &mapOptions, &map->field))
+        {
+            freeMaze(&map->maze);
+            freeDaemon(&daemon);
+            errorHandle(5);
+        }
+        daemon.mapCount++;
+    }
+
+    int listenFd = -1;
+    if (options->daemonPath != NULL)
+    {
+        listenFd = openDaemonSocket(options->daemonPath);
+        if (listenFd == -1)
+        {
+            freeDaemon(&daemon);
+            errorHandle(8);
+        }
+
+        // a client which leaves early must not stop the daemon.
+        signal(SIGPIPE, SIG_IGN);
+
+        // the workers wake the main thread up when an answer is ready to be sent.
+        if (pipe(daemon.wakeFds) == -1)
+        {
+            close(listenFd);
+            unlink(options->daemonPath);
+            freeDaemon(&daemon);
+            errorHandle(5);
+        }
+        fcntl(daemon.wakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(daemon.wakeFds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    // the signals stop the main thread, so the workers don't receive them.
+    daemonWakeFd = daemon.wakeFds[1];
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopDaemon;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    DaemonWorker *workers = calloc(options->threads, sizeof(DaemonWorker));
+    pthread_t *threads = malloc(sizeof(pthread_t) * options->threads);
+    if (workers == NULL || threads == NULL)
+    {
+        free(workers);
+        free(threads);
+        if (listenFd != -1)
+        {
+            close(listenFd);
+            unlink(options->daemonPath);
+        }
+        freeDaemon(&daemon);
+        errorHandle(5);
+    }
+
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.jobCond, NULL);
+    pthread_cond_init(&daemon.spaceCond, NULL);
+    pthread_cond_init(&daemon.turnCond, NULL);
+
+    // If some threads can't be created, the daemon uses fewer threads.
+    int started = 0;
+    for (; started < options->threads; ++started)
+    {
+        DaemonWorker *worker = &workers[started];
+        char *buffer = malloc(OUTPUT_BUFFER_SIZE);
+        if (buffer == NULL)
+        {
+            break;
+        }
+
+        worker->daemon = &daemon;
+        initPathWriter(&worker->writer, buffer, OUTPUT_BUFFER_SIZE, daemon.compact, NULL);
+        if (pthread_create(&threads[started], NULL, serveDaemon, worker) != 0)
+        {
+            free(buffer);
+            break;
+        }
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+    bool failed = started == 0;
+    if (!failed && listenFd != -1)
+    {
+        // the main thread waits for all the clients at once, and each query goes to the next free worker.
+        failed = !serveClients(&daemon, listenFd);
+    }
+    else if (!failed)
+    {
+        // the lines from stdin are numbered, each worker takes the next one.
+        char *line = NULL;
+        size_t limit = 0;
+        DaemonJob job;
+        job.client = NULL;
+        job.sequence = 0;
+
+        // a signal interrupts "getline", so the daemon stops like at the end of the input.
+        while (!daemonStopped && getline(&line, &limit, stdin) != -1)
+        {
+            // skip the empty lines.
+            if (strspn(line, " \t\r\n") == strlen(line))
+            {
+                continue;
+            }
+
+            // a line which is too long can't be a valid query.
+            const size_t length = strlen(line);
+            if (length < QUERY_LINE_SIZE)
+            {
+                memcpy(job.line, line, length + 1);
+            }
+            else
+            {
+                strcpy(job.line, "-");
+            }
+
+            pushDaemonJob(&daemon, &job);
+            job.sequence++;
+        }
+
+        free(line);
+    }
+
+    // the workers finish the waiting jobs, then they stop.
+    pthread_mutex_lock(&daemon.lock);
+    daemon.closed = true;
+    pthread_cond_broadcast(&daemon.jobCond);
+    pthread_mutex_unlock(&daemon.lock);
+
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        free(workers[i].writer.buffer);
+    }
+
+    // the clients still connected are closed once no worker uses them.
+    for (int i = 0; i < daemon.clientCount; ++i)
+    {
+        close(daemon.clients[i]->fd);
+        free(daemon.clients[i]->output);
+        free(daemon.clients[i]);
     }
-    else if (argc == 3)
+    free(daemon.clients);
+    daemonWakeFd = -1;
+    if (daemon.wakeFds[0] != -1)
     {
-        x = readCoordinate(argv[1]);
-        y = readCoordinate(argv[2]);
-
-        fPtr = fopen("dungeon.map", "r");
-        if (fPtr == NULL)
-        {
-            errorHandle(3);
-        }
+        close(daemon.wakeFds[0]);
+        close(daemon.wakeFds[1]);
     }
-    else
+
+    pthread_cond_destroy(&daemon.turnCond);
+    pthread_cond_destroy(&daemon.spaceCond);
+    pthread_cond_destroy(&daemon.jobCond);
+    pthread_mutex_destroy(&daemon.lock);
+    free(workers);
+    free(threads);
+    if (listenFd != -1)
     {
-        errorHandle(1);
+        close(listenFd);
+        unlink(options->daemonPath);
     }
+    freeDaemon(&daemon);
 
-    int width, height;
-    getMazeSize(fPtr, &width, &height);
-    
-    char *mazePtr = getMaze(fPtr, width, height);
-    fclose(fPtr);
+    if (failed)
+    {
+        errorHandle(5);
+    }
+}
 
-    // If the route exists, it will be printed in this function.
-    getShortestPath(mazePtr, width, height, x, y);
-    free(mazePtr);
+// This function free all the maps and fields loaded by the daemon.
+void freeDaemon(Daemon *daemon)
+{
+    for (int i = 0; i < daemon->mapCount; ++i)
+    {
+        freeField(&daemon->maps[i].field);
+        freeMaze(&daemon->maps[i].maze);
+    }
 
-    return 0;
+    free(daemon->maps);
+    daemon->maps = NULL;
+    daemon->mapCount = 0;
 }
 
-// This function is used to exit the program.
-// Use error-code to prompt different error messages.
-void errorHandle(const int errorCode)
+// This function adds a job at the end of the queue of the daemon.
+// It waits while the queue is full.
+// It returns false if the daemon has been closed.
+bool pushDaemonJob(Daemon *daemon, const DaemonJob *job)
 {
-    if (errorCode < 1 || errorCode > 5)
+    pthread_mutex_lock(&daemon->lock);
+    while (daemon->jobCount == DAEMON_QUEUE_SIZE && !daemon->closed)
     {
-        // handle invalid errorCode
-        return;
+        pthread_cond_wait(&daemon->spaceCond, &daemon->lock);
     }
 
-    switch (errorCode)
+    const bool open = !daemon->closed;
+    if (open)
     {
-        case 1:
-            puts("Invalid command line arguments. Usage: [filename] <x> <y>");
-            break;
-
-        case 2:
-            puts("Invalid dungeon file!");
-            break;
-
-        case 3:
-            // Print the specific error message in this situation.
-            perror("Error reading dungeon file");
-            break;
-
-        case 4:
-            puts("Invalid starting location!");
-            break;
-
-        case 5:
-            puts("Unable to allocate memory.");
-            break;
+        daemon->jobs[(daemon->jobHead + daemon->jobCount) % DAEMON_QUEUE_SIZE] = *job;
+        daemon->jobCount++;
+        pthread_cond_signal(&daemon->jobCond);
     }
+    pthread_mutex_unlock(&daemon->lock);
 
-    exit(errorCode);
+    return open;
 }
 
-// This function is used to read coordinate (x,y).
-// It calls "errorHandle" fucntion when error occurs.
-int readCoordinate(const char *string)
+// This function removes the first job from the queue of the daemon.
+// It waits while the queue is empty.
+// It returns false when the daemon has been closed and all the jobs are done.
+bool popDaemonJob(Daemon *daemon, DaemonJob *job)
 {
-    char *endPtr;
-    long num = strtol(string, &endPtr, 10);
-
-    // If the string contain any non-digit char, it's invalid.
-    // If the value is negative, it's also invalid.
-    if (*endPtr != '\0' || num < 0)
+    pthread_mutex_lock(&daemon->lock);
+    while (daemon->jobCount == 0 && !daemon->closed)
     {
-        errorHandle(1);
+        pthread_cond_wait(&daemon->jobCond, &daemon->lock);
     }
 
-    // Check the convertion from long to int is safe.
-    if (num > INT_MAX || num < INT_MIN)
+    const bool found = daemon->jobCount > 0;
+    if (found)
     {
-        errorHandle(1);
+        *job = daemon->jobs[daemon->jobHead];
+        daemon->jobHead = (daemon->jobHead + 1) % DAEMON_QUEUE_SIZE;
+        daemon->jobCount--;
+        pthread_cond_signal(&daemon->spaceCond);
     }
+    pthread_mutex_unlock(&daemon->lock);
 
-    return (int)num;
+    return found;
 }
 
-// This function read a char from "fPtr", and save it into "dest".
-// The parameter "buffer" is used for memory management, enter NULL to omit it.
-void readOneChar(FILE *fPtr, char *dest, char *buffer)
+// This function writes the answer of one query into the writer of the worker.
+// Each answer ends with an empty line, like "--queries".
+void answerDaemonQuery(const Daemon *daemon, DaemonWorker *worker, const char *line)
 {
-    if (fscanf(fPtr, "%c", dest) != 1)
+    PathWriter *writer = &worker->writer;
+
+    // the first word is the name of the map.
+    while (isspace((unsigned char)*line))
     {
-        // free memory before exit the program.
-        free(buffer);
+        line++;
+    }
+    const size_t nameLength = strcspn(line, " \t\r\n");
 
-        if (feof(fPtr))
-        {
-            // the file end in advance, its format is invalid.
-            fclose(fPtr);
-            errorHandle(2);
-        }
-        else
+    const DaemonMap *map = NULL;
+    for (int i = 0; i < daemon->mapCount && map == NULL; ++i)
+    {
+        if (daemon->maps[i].nameLength == nameLength && strncmp(daemon->maps[i].name, line, nameLength) == 0)
         {
-            // the error is not related to file's content.
-            fclose(fPtr);
-            errorHandle(3);
+            map = &daemon->maps[i];
         }
     }
-}
-
-// This function is used to read the maze's width and height.
-// It calls "errorHandle" fucntion when error occurs.
-void getMazeSize(FILE *fPtr, int *width, int *height)
-{
-    char tmp;
-    readOneChar(fPtr, &tmp, NULL);
 
-    // If the file starts with a non-digit char, it's invalid.
-    if (!isdigit(tmp))
+    int x, y;
+    if (map == NULL)
     {
-        fclose(fPtr);
-        errorHandle(2);
+        writeText(writer, "Unknown map!\n");
     }
+    else if (!readQuery(line + nameLength, &x, &y) || x >= map->maze.width || y >= map->maze.height ||
+             *(map->maze.cells + y * map->maze.stride + x) == '#')
+    {
+        writeText(writer, "Invalid starting location!\n");
+    }
+    else
+    {
+        printFieldPath(&map->maze, &map->field, x, y, writer);
+    }
+    writeText(writer, "\n");
 
-    // return the beginning to read numbers.
-    rewind(fPtr);
-
-    // read the maze's width and height.
-    if (fscanf(fPtr, "%d %d", width, height) != 2)
+    // the buffer is kept, only the answer is replaced.
+    if (writer->failed)
     {
-        fclose(fPtr);
-        errorHandle(2);
+        writer->size = 0;
+        writer->failed = false;
+        writeText(writer, "Unable to allocate memory.\n\n");
     }
+}
 
-    readOneChar(fPtr, &tmp, NULL);
+// This function is the handler of "SIGINT" and "SIGTERM" in the daemon.
+void stopDaemon(const int signal)
+{
+    (void)signal;
+    const int error = errno;
 
-    // check whether there is any invalid character after two numbers.
-    if (tmp != '\n')
+    daemonStopped = 1;
+    if (daemonWakeFd != -1)
     {
-        fclose(fPtr);
-        errorHandle(2);
+        const ssize_t written = write(daemonWakeFd, "", 1);
+        (void)written;
     }
+
+    errno = error;
 }
 
-// This function store the maze into a buffer.
-// It return a pointer of this buffer.
-// It calls "errorHandle" fucntion when error occurs.
-char *getMaze(FILE *fPtr, const int width, const int height)
+// This function wakes the main thread of the daemon up, if it's waiting for the clients.
+void wakeDaemon(const Daemon *daemon)
 {
-    const int bufferSize = width * height;
-    char *buffer = malloc(sizeof(char) * bufferSize);
-    if (buffer == NULL)
+    if (daemon->wakeFds[1] != -1)
     {
-        fclose(fPtr);
-        errorHandle(5);
+        // the pipe can only be full if the main thread hasn't woken up yet.
+        const ssize_t written = write(daemon->wakeFds[1], "", 1);
+        (void)written;
     }
+}
 
-    // count the number of exits
-    unsigned int count = 0;
+// This function waits for all the clients of the socket at once, until a signal stops the daemon.
+// It reads the queries and sends the answers, the workers answer the queries in between.
+// It returns false when error occurs.
+bool serveClients(Daemon *daemon, const int listenFd)
+{
+    struct pollfd *polls = NULL;
+    int pollLimit = 0;
+    bool done = true;
+
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
 
-    for (int row = 0; row < height; ++row)
+    while (!daemonStopped)
     {
-        for (int col = 0; col < width; ++col)
+        // malloc more memory when reach the limit
+        if (daemon->clientCount + 2 > pollLimit)
         {
-            char tmp;
-            readOneChar(fPtr, &tmp, buffer);
-
-            // check whether this location is valid.
-            if ((tmp != '.' && tmp != '#' && tmp != 'x'))
+            const int limit = daemon->clientLimit + 2;
+            struct pollfd *newPolls = realloc(polls, sizeof(struct pollfd) * limit);
+            if (newPolls == NULL)
             {
-                free(buffer);
-                fclose(fPtr);
-                errorHandle(2);
+                done = false;
+                break;
             }
 
-            // update the number of exits.
-            if (tmp == 'x')
+            polls = newPolls;
+            pollLimit = limit;
+        }
+
+        polls[0].fd = daemon->wakeFds[0];
+        polls[0].events = POLLIN;
+        polls[1].fd = listenFd;
+        polls[1].events = POLLIN;
+
+        // a client is only read while it hasn't too many queries waiting or answers not sent.
+        pthread_mutex_lock(&daemon->lock);
+        for (int i = 0; i < daemon->clientCount; ++i)
+        {
+            const DaemonClient *client = daemon->clients[i];
+            short events = 0;
+
+            if (!client->closing && !client->failed && client->pending < DAEMON_CLIENT_PENDING &&
+                client->outputSize - client->outputSent < OUTPUT_BUFFER_SIZE)
+            {
+                events |= POLLIN;
+            }
+            if (!client->failed && client->outputSent < client->outputSize)
             {
-                count++;
+                events |= POLLOUT;
             }
 
-            *(buffer + row * width + col) = tmp;
+            // the clients with nothing to do are left out, so a closed connection doesn't wake it up.
+            polls[i + 2].fd = (events != 0) ? client->fd : -1;
+            polls[i + 2].events = events;
         }
+        pthread_mutex_unlock(&daemon->lock);
+
+        const int clientCount = daemon->clientCount;
+        if (poll(polls, clientCount + 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
 
-        // check the last char of this line.
-        char tmp;
-        readOneChar(fPtr, &tmp, buffer);
+            perror("Error waiting for daemon clients");
+            break;
+        }
 
-        // check whether this char is valid.
-        if (tmp != '\n')
+        if (polls[0].revents != 0)
         {
-            free(buffer);
-            fclose(fPtr);
-            errorHandle(2);
+            char drain[64];
+            while (read(daemon->wakeFds[0], drain, sizeof(drain)) > 0)
+            {
+            }
         }
 
-    }
+        for (int i = 0; i < clientCount; ++i)
+        {
+            const short events = polls[i + 2].events;
+            const short revents = polls[i + 2].revents;
 
-    // A valid maze can only have one exit.
-    if (count != 1)
-    {
-        free(buffer);
-        fclose(fPtr);
-        errorHandle(2);
+            if ((events & POLLIN) && (revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                readClient(daemon, daemon->clients[i]);
+            }
+            if ((events & POLLOUT) && (revents & (POLLOUT | POLLHUP | POLLERR)))
+            {
+                sendClient(daemon, daemon->clients[i]);
+            }
+        }
+        removeClients(daemon);
+
+        if ((polls[1].revents & POLLIN) && !acceptClient(daemon, listenFd))
+        {
+            done = false;
+            break;
+        }
     }
 
-    return buffer;
+    free(polls);
+    return done;
 }
 
-// This function append a new point at the end of queue.
-// It returns the pointer of the new point.
-// It returns NULL when error occurs.
-Point *appendPoint(Point *tailPtr)
+// This function accepts a new client of the socket and adds it to the list of clients.
+// It returns false when error occurs.
+bool acceptClient(Daemon *daemon, const int listenFd)
 {
-    Point *newPoint = malloc(sizeof(Point));
-    if (newPoint == NULL)
+    const int fd = accept(listenFd, NULL, NULL);
+    if (fd == -1)
     {
-        return NULL;
+        // the client may have left already.
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+        {
+            perror("Error accepting daemon client");
+        }
+        return true;
     }
 
-    Point *prePoint = tailPtr;
+    // malloc more memory when reach the limit
+    if (daemon->clientCount == daemon->clientLimit)
+    {
+        const int limit = daemon->clientLimit == 0 ? DAEMON_CLIENT_LIST_SIZE : daemon->clientLimit * 2;
+        DaemonClient **clients = realloc(daemon->clients, sizeof(DaemonClient *) * limit);
+        if (clients == NULL)
+        {
+            close(fd);
+            return false;
+        }
+
+        daemon->clients = clients;
+        daemon->clientLimit = limit;
+    }
 
-    if (prePoint == NULL)
+    DaemonClient *client = calloc(1, sizeof(DaemonClient));
+    if (client == NULL)
     {
-        return newPoint;
+        close(fd);
+        return false;
     }
 
-    prePoint->nextPtr = newPoint;
-    return newPoint;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    client->fd = fd;
+    daemon->clients[daemon->clientCount++] = client;
+    return true;
 }
 
-// This function free all the memory allcated for the queue.
-void freeAllPoints(Point *startPtr)
+// This function reads the available queries of a client and gives them to the workers.
+// The client is closing when it has sent all its queries.
+void readClient(Daemon *daemon, DaemonClient *client)
 {
-    if (startPtr == NULL)
+    char chunk[OUTPUT_BUFFER_SIZE / 16];
+    const ssize_t count = read(client->fd, chunk, sizeof(chunk));
+
+    if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        return;
+    }
+    else if (count <= 0)
     {
+        // the last line may not end with '\n'.
+        if (client->inputSize > 0 || client->overlong)
+        {
+            pushClientLine(daemon, client);
+        }
+        client->closing = true;
         return;
     }
 
-    Point *currentPtr = startPtr;
-    
-    while (currentPtr != NULL)
+    for (ssize_t i = 0; i < count; ++i)
     {
-        Point *tmpPtr = currentPtr->nextPtr;
-        free(currentPtr);
-        currentPtr = tmpPtr;
-    }  
+        if (chunk[i] == '\n')
+        {
+            pushClientLine(daemon, client);
+        }
+        else if (client->inputSize + 1 < QUERY_LINE_SIZE)
+        {
+            client->input[client->inputSize++] = chunk[i];
+        }
+        else
+        {
+            client->overlong = true;
+        }
+    }
 }
 
-// This function uses BFS to find the shortest path.
-// It calls "errorHandle" fucntion when error occurs.
-void getShortestPath(char *mazePtr, const int width, const int height, const int x, const int y)
+// This function gives the line read from a client to the workers, the empty lines are skipped.
+void pushClientLine(Daemon *daemon, DaemonClient *client)
 {
-    if (x >= width || y >= height)
+    DaemonJob job;
+    job.client = client;
+
+    // a line which is too long can't be a valid query.
+    if (client->overlong)
     {
-        // the starting location is out of the maze.
-        free(mazePtr);
-        errorHandle(4);
+        strcpy(job.line, "-");
     }
-    else if (*(mazePtr + y * width + x) == '#')
+    else
     {
-        // the starting location is a wall.
-        free(mazePtr);
-        errorHandle(4);
+        memcpy(job.line, client->input, client->inputSize);
+        job.line[client->inputSize] = '\0';
     }
-    else if (*(mazePtr + y * width + x) == 'x')
+
+    client->inputSize = 0;
+    client->overlong = false;
+    if (strspn(job.line, " \t\r") == strlen(job.line))
     {
-        // the starting location is the exit.
-        printf("%d,%d\n", x, y);
         return;
     }
 
-    // use a 2D array to record which points have been visited.
-    bool *visited = malloc(sizeof(bool) * width * height);
-    if (visited == NULL)
-    {
-        free(mazePtr);
-        errorHandle(5);
-    }
+    pthread_mutex_lock(&daemon->lock);
+    client->pending++;
+    pthread_mutex_unlock(&daemon->lock);
+
+    job.sequence = client->nextQuery++;
+    pushDaemonJob(daemon, &job);
+}
 
-    // initialize "visited" array.
-    for (int i = 0; i < height; ++i)
+// This function sends as many answers to a client as the socket takes without waiting.
+void sendClient(Daemon *daemon, DaemonClient *client)
+{
+    // the workers may grow the output meanwhile, so it's sent under the lock.
+    pthread_mutex_lock(&daemon->lock);
+    const ssize_t written = write(client->fd, client->output + client->outputSent,
+                                  client->outputSize - client->outputSent);
+
+    if (written > 0)
     {
-        for (int j = 0; j < width; ++j)
+        client->outputSent += (size_t)written;
+        if (client->outputSent == client->outputSize)
         {
-            *(visited + i * width + j) = 0;
+            client->outputSent = 0;
+            client->outputSize = 0;
         }
     }
+    else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        // the client has left, its answers are dropped.
+        client->failed = true;
+    }
+    pthread_mutex_unlock(&daemon->lock);
+}
 
-    // create a queue to keep track of points.
-    Point *headPtr = NULL;
-    Point *tailPtr = NULL;
+// This function adds the answer in the writer of the worker to the output of the client.
+// The answers are added in the order of the queries.
+void addClientAnswer(Daemon *daemon, DaemonWorker *worker, const DaemonJob *job)
+{
+    DaemonClient *client = job->client;
+    PathWriter *writer = &worker->writer;
 
-    Point *startPtr = appendPoint(tailPtr);
-    if (startPtr == NULL)
+    pthread_mutex_lock(&daemon->lock);
+    while (client->nextAnswer != job->sequence)
     {
-        free(mazePtr);
-        free(visited);
-        errorHandle(5);
+        pthread_cond_wait(&daemon->turnCond, &daemon->lock);
     }
 
-    // update headPtr and tailPtr.
-    headPtr = startPtr;
-    tailPtr = startPtr;
-
-    // store the starting location.
-    startPtr->x = x;
-    startPtr->y = y;
-    startPtr->parentPtr = NULL;
-    startPtr->nextPtr = NULL;
+    // malloc more memory when reach the limit
+    if (!client->failed && client->outputSize + writer->size > client->outputLimit)
+    {
+        size_t limit = (client->outputLimit == 0) ? OUTPUT_BUFFER_SIZE : client->outputLimit;
+        while (limit < client->outputSize + writer->size)
+        {
+            limit *= 2;
+        }
 
-    bool found = false;
+        char *output = realloc(client->output, limit);
+        if (output == NULL)
+        {
+            client->failed = true;
+        }
+        else
+        {
+            client->output = output;
+            client->outputLimit = limit;
+        }
+    }
 
-    while (headPtr != NULL)
+    if (!client->failed)
     {
-        unsigned int currentX = headPtr->x;
-        unsigned int currentY = headPtr->y;
-
-        // use two arrays to store four directions' coordinates.
-        const int coorX[4] = {currentX, currentX, currentX - 1, currentX + 1};
-        const int coorY[4] = {currentY - 1, currentY + 1, currentY, currentY};
+        memcpy(client->output + client->outputSize, writer->buffer, writer->size);
+        client->outputSize += writer->size;
+    }
 
-        for (int i = 0; i < 4; ++i)
-        {
-            if (coorX[i] < 0 || coorX[i] >= width || coorY[i] < 0 || coorY[i] >= height)
-            {
-                // this point is out of the maze.
-                continue;
-            }
-            else if (*(visited + coorY[i] * width + coorX[i]) == 1)
-            {
-                // this point has been visited.
-                continue;
-            }
+    client->nextAnswer++;
+    client->pending--;
+    pthread_cond_broadcast(&daemon->turnCond);
+    pthread_mutex_unlock(&daemon->lock);
 
-            char content = *(mazePtr + coorY[i] * width + coorX[i]);
+    writer->size = 0;
+    wakeDaemon(daemon);
+}
 
-            if (content != '#')
-            {
-                // append the new point, if it's not a wall.
-                Point *newPoint = appendPoint(tailPtr);
-                if (newPoint == NULL)
-                {
-                    free(mazePtr);
-                    free(visited);
-                    freeAllPoints(startPtr);
-                    errorHandle(5);
-                }
+// This function closes the clients which are done, once their answers have been sent or dropped.
+void removeClients(Daemon *daemon)
+{
+    pthread_mutex_lock(&daemon->lock);
+    for (int i = 0; i < daemon->clientCount;)
+    {
+        DaemonClient *client = daemon->clients[i];
+        const bool done = (client->closing || client->failed) && client->pending == 0 &&
+                          (client->failed || client->outputSize == 0);
 
-                newPoint->x = coorX[i];
-                newPoint->y = coorY[i];
-                newPoint->parentPtr = headPtr;
-                newPoint->nextPtr = NULL;
+        if (!done)
+        {
+            i++;
+            continue;
+        }
 
-                // record this point as "visited".
-                *(visited + coorY[i] * width + coorX[i]) = 1;
+        close(client->fd);
+        free(client->output);
+        free(client);
+        daemon->clients[i] = daemon->clients[--daemon->clientCount];
+    }
+    pthread_mutex_unlock(&daemon->lock);
+}
 
-                // update tailPtr.
-                tailPtr = newPoint;
+// This function is run by every worker of the daemon.
+// The answers to stdin are printed in the order of the queries.
+void *serveDaemon(void *arg)
+{
+    DaemonWorker *worker = arg;
+    Daemon *daemon = worker->daemon;
+    DaemonJob job;
 
-                if (content == 'x')
-                {
-                    found = true;
-                    break;
-                }
-            }
+    while (popDaemonJob(daemon, &job))
+    {
+        answerDaemonQuery(daemon, worker, job.line);
+        if (job.client != NULL)
+        {
+            addClientAnswer(daemon, worker, &job);
+            continue;
         }
 
-        if (found)
+        // wait until the answers of the earlier lines have been printed.
+        pthread_mutex_lock(&daemon->lock);
+        while (daemon->nextSequence != job.sequence)
         {
-            break;
+            pthread_cond_wait(&daemon->turnCond, &daemon->lock);
         }
+        pthread_mutex_unlock(&daemon->lock);
 
-        // dequeue the first point
-        headPtr = headPtr->nextPtr;
-    }
+        fwrite(worker->writer.buffer, sizeof(char), worker->writer.size, stdout);
+        fflush(stdout);
+        worker->writer.size = 0;
 
-    if (!found)
-    {
-        printf("%d,%d\n", x, y);
-        puts("No escape possible.");
-    }
-    else if (!printShortestPath(tailPtr))
-    {
-        // error occurs in printing the path.
-        free(mazePtr);
-        free(visited);
-        freeAllPoints(startPtr);
-        errorHandle(5);
+        pthread_mutex_lock(&daemon->lock);
+        daemon->nextSequence++;
+        pthread_cond_broadcast(&daemon->turnCond);
+        pthread_mutex_unlock(&daemon->lock);
     }
 
-    free(visited);
-    freeAllPoints(startPtr);
+    return NULL;
 }
 
-// This function free all the memory allcated for the record stack.
-void freeAllRecords(Record *topPtr)
+// This function creates the Unix socket of the daemon at "path" and listens to it.
+// An old socket file at "path" is replaced.
+// It returns -1 when error occurs.
+int openDaemonSocket(const char *path)
 {
-    if (topPtr == NULL)
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path))
     {
-        return;
+        errno = ENAMETOOLONG;
+        return -1;
     }
+    strcpy(address.sun_path, path);
 
-    Record *currentPtr = topPtr;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
 
-    while (currentPtr != NULL)
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
     {
-        Record *tmpPtr = currentPtr->prevPtr;
-        free(currentPtr);
-        currentPtr = tmpPtr;
+        unlink(path);
     }
-}
 
-// This function uses stack to save the path.
-// It returns false when it's unable to allocate memory.
-bool printShortestPath(Point *exitPointPtr)
-{
-    Record *exitRecord = malloc(sizeof(Record));
-    if (exitRecord == NULL)
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1)
     {
-        return false;
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
     }
 
-    // initialize the first element of the record stack.
-    exitRecord->pointPtr = exitPointPtr;
-    exitRecord->prevPtr = NULL;
+    return fd;
+}
 
-    // keep track of the top of the stack.
-    Record *topRecordPtr = exitRecord;
+#ifdef DUNGEON_STATS
+// the allocation functions below call the real ones.
+#undef malloc
+#undef calloc
+#undef realloc
 
-    // traverse the shortest path in reversed direction.
-    Point *curPointPtr = exitPointPtr->parentPtr;
-    while (curPointPtr != NULL)
-    {
-        Record *newRecord = malloc(sizeof(Record));
-        if (newRecord == NULL)
-        {
-            freeAllRecords(topRecordPtr);
-            return false;
-        }
+// This function ends the current phase of "--stats" and starts "phase".
+// Enter "PHASE_COUNT" to only end the current phase.
+void markStatPhase(const int phase)
+{
+    const double now = getTime();
 
-        // record each point's address
-        newRecord->pointPtr = curPointPtr;
-        newRecord->prevPtr = topRecordPtr;
+    if (stats.phaseStart > 0 && stats.phase < PHASE_COUNT)
+    {
+        stats.phaseTimes[stats.phase] += now - stats.phaseStart;
+    }
 
-        // update the topRecordPtr
-        topRecordPtr = newRecord;
+    stats.phase = phase;
+    stats.phaseStart = now;
+}
 
-        // update the curPointPtr
-        curPointPtr = curPointPtr->parentPtr;
+// This function raises "counter" to "value" if it's larger.
+void updateStatMax(atomic_ullong *counter, const unsigned long long value)
+{
+    unsigned long long current = atomic_load_explicit(counter, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(counter, &current, value, memory_order_relaxed, memory_order_relaxed))
+    {
     }
+}
 
-    // print the path from the top of the stack
-    Record *curRecordPtr = topRecordPtr;
-    while (curRecordPtr != NULL)
-    {
-        Point *curPointPtr = curRecordPtr->pointPtr;
-        printf("%d,%d\n", curPointPtr->x, curPointPtr->y);
+// These functions count the bytes requested from the allocator.
+// A growing block only adds the bytes it grows by, so the growth loops are counted once.
+void *statMalloc(const size_t size)
+{
+    STAT_ADD(bytes, size);
+    return malloc(size);
+}
 
-        curRecordPtr = curRecordPtr->prevPtr;
-    }
+void *statCalloc(const size_t count, const size_t size)
+{
+    STAT_ADD(bytes, count * size);
+    return calloc(count, size);
+}
 
-    freeAllRecords(topRecordPtr);
-    return true;
-}
\ No newline at end of file
+void *statRealloc(void *ptr, const size_t size)
+{
+    const size_t oldSize = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+    STAT_ADD(bytes, (size > oldSize) ? size - oldSize : 0);
+    return realloc(ptr, size);
+}
+#endif
@@ -0,0 +1,442 @@
+// 6518738 zy18738 Hangjian Yuan
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+// the side of a room in the "rooms" maps, the walls between rooms are 1 cell wide.
+#define ROOM_SIZE 8
+
+// a cell of a "cave" map starts as a wall with this chance in percent.
+#define CAVE_FILL 40
+
+// the kinds of map which can be generated.
+enum mapType { MAP_MAZE, MAP_CAVE, MAP_ROOMS, MAP_SERPENTINE };
+
+// this structure is used to store the generator settings and its state.
+// "open" is only used by the mazes, one bit per cell.
+// "caveRows" is only used by the caves, three rows of the first random fill.
+struct generator {
+    int type;
+    int width;
+    int height;
+    uint64_t seed;
+    uint64_t *open;
+    unsigned char *caveRows;
+};
+typedef struct generator Generator;
+
+// function prototypes
+void errorHandle(const int errorCode);
+int readSize(const char *string);
+void readArguments(const int argc, char const *argv[], Generator *generator, const char **path);
+uint64_t mixRandom(uint64_t value);
+uint64_t hashRandom(const uint64_t seed, const uint64_t a, const uint64_t b);
+bool isMazeOpen(const Generator *generator, const int64_t cell);
+void setMazeOpen(Generator *generator, const int64_t cell);
+bool carveMaze(Generator *generator);
+bool getCaveWall(const Generator *generator, const int x, const int y);
+void fillCaveRow(Generator *generator, const int y);
+bool getRoomWall(const Generator *generator, const int x, const int y);
+bool isExitCell(const Generator *generator, const int x, const int y);
+void fillRow(Generator *generator, const int y, char *row);
+bool writeMap(Generator *generator, FILE *fPtr);
+
+int main(int argc, char const *argv[])
+{
+    Generator generator;
+    const char *path;
+    readArguments(argc, argv, &generator, &path);
+
+    // only the mazes are carved in memory, the other maps are made row by row.
+    generator.open = NULL;
+    generator.caveRows = NULL;
+    if (generator.type == MAP_MAZE && !carveMaze(&generator))
+    {
+        errorHandle(3);
+    }
+    else if (generator.type == MAP_CAVE)
+    {
+        generator.caveRows = malloc(sizeof(unsigned char) * 3 * generator.width);
+        if (generator.caveRows == NULL)
+        {
+            errorHandle(3);
+        }
+    }
+
+    FILE *fPtr = stdout;
+    if (path != NULL)
+    {
+        fPtr = fopen(path, "w");
+        if (fPtr == NULL)
+        {
+            free(generator.open);
+            free(generator.caveRows);
+            errorHandle(2);
+        }
+    }
+
+    bool written = writeMap(&generator, fPtr);
+    if (fPtr != stdout && fclose(fPtr) != 0)
+    {
+        written = false;
+    }
+
+    free(generator.open);
+    free(generator.caveRows);
+
+    if (!written)
+    {
+        errorHandle(2);
+    }
+
+    return 0;
+}
+
+// This function is used to exit the program.
+void errorHandle(const int errorCode)
+{
+    switch (errorCode)
+    {
+        case 1:
+            puts("Invalid command line arguments. Usage: <maze|cave|rooms|serpentine> <width> <height> <seed> [output]");
+            break;
+
+        case 2:
+            perror("Error writing map file");
+            break;
+
+        case 3:
+            puts("Unable to allocate memory.");
+            break;
+    }
+
+    exit(errorCode);
+}
+
+// This function reads the width or the height of the map.
+// It calls "errorHandle" fucntion when error occurs.
+int readSize(const char *string)
+{
+    char *endPtr;
+    long num = strtol(string, &endPtr, 10);
+
+    if (*string == '\0' || *endPtr != '\0' || num < 1 || num > INT32_MAX)
+    {
+        errorHandle(1);
+    }
+
+    return (int)num;
+}
+
+// This function reads the command line arguments.
+// The map is written to "path", or to stdout if "path" is NULL.
+// It calls "errorHandle" fucntion when error occurs.
+void readArguments(const int argc, char const *argv[], Generator *generator, const char **path)
+{
+    const char *names[] = {"maze", "cave", "rooms", "serpentine"};
+
+    if (argc != 5 && argc != 6)
+    {
+        errorHandle(1);
+    }
+
+    generator->type = -1;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (strcmp(argv[1], names[i]) == 0)
+        {
+            generator->type = i;
+        }
+    }
+
+    char *endPtr;
+    generator->width = readSize(argv[2]);
+    generator->height = readSize(argv[3]);
+    generator->seed = strtoull(argv[4], &endPtr, 10);
+
+    if (generator->type == -1 || *argv[4] == '\0' || *endPtr != '\0')
+    {
+        errorHandle(1);
+    }
+
+    *path = (argc == 6) ? argv[5] : NULL;
+}
+
+// This function mixes the bits of "value", so close values give unrelated results.
+uint64_t mixRandom(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+    return value ^ (value >> 31);
+}
+
+// This function returns a random number which only depends on the seed, "a" and "b".
+// So any part of a map can be made again without the parts before it.
+uint64_t hashRandom(const uint64_t seed, const uint64_t a, const uint64_t b)
+{
+    return mixRandom(mixRandom(seed ^ mixRandom(a)) ^ b);
+}
+
+// This function checks whether a cell of the maze has been carved.
+bool isMazeOpen(const Generator *generator, const int64_t cell)
+{
+    return (generator->open[cell / 64] >> (cell % 64)) & 1;
+}
+
+// This function carves a cell of the maze.
+void setMazeOpen(Generator *generator, const int64_t cell)
+{
+    generator->open[cell / 64] |= (uint64_t)1 << (cell % 64);
+}
+
+// This function carves a perfect maze with a randomized DFS.
+// The rooms of the maze are the cells with even coordinates, and the cells between them are walls or doors.
+// Each room keeps the direction back to its parent, so the DFS doesn't need a stack.
+// It returns false when error occurs.
+bool carveMaze(Generator *generator)
+{
+    const int64_t width = generator->width;
+    const int64_t roomsX = (width + 1) / 2;
+    const int64_t roomsY = ((int64_t)generator->height + 1) / 2;
+    const int64_t cells = width * generator->height;
+
+    // the directions are up, down, left and right, 2 bits per room.
+    const int dx[4] = {0, 0, -1, 1};
+    const int dy[4] = {-1, 1, 0, 0};
+    unsigned char *parents = calloc(roomsX * roomsY / 4 + 1, sizeof(unsigned char));
+    generator->open = calloc(cells / 64 + 1, sizeof(uint64_t));
+    if (parents == NULL || generator->open == NULL)
+    {
+        free(parents);
+        free(generator->open);
+        return false;
+    }
+
+    uint64_t state = generator->seed;
+    int64_t x = 0;
+    int64_t y = 0;
+    setMazeOpen(generator, 0);
+
+    while (true)
+    {
+        // find the rooms next to this one which haven't been carved.
+        int choices[4];
+        int count = 0;
+        for (int dir = 0; dir < 4; ++dir)
+        {
+            const int64_t nextX = x + dx[dir] * 2;
+            const int64_t nextY = y + dy[dir] * 2;
+
+            if (nextX >= 0 && nextX < width && nextY >= 0 && nextY < generator->height &&
+                !isMazeOpen(generator, nextY * width + nextX))
+            {
+                choices[count++] = dir;
+            }
+        }
+
+        if (count > 0)
+        {
+            state = mixRandom(state);
+            const int dir = choices[state % count];
+
+            // carve the wall between the rooms and go into the next room.
+            setMazeOpen(generator, (y + dy[dir]) * width + x + dx[dir]);
+            x += dx[dir] * 2;
+            y += dy[dir] * 2;
+            setMazeOpen(generator, y * width + x);
+
+            // the way back is the opposite direction.
+            const int64_t room = (y / 2) * roomsX + x / 2;
+            parents[room / 4] |= (dir ^ 1) << ((room % 4) * 2);
+        }
+        else if (x == 0 && y == 0)
+        {
+            break;
+        }
+        else
+        {
+            const int64_t room = (y / 2) * roomsX + x / 2;
+            const int dir = (parents[room / 4] >> ((room % 4) * 2)) & 3;
+            x += dx[dir] * 2;
+            y += dy[dir] * 2;
+        }
+    }
+
+    free(parents);
+    return true;
+}
+
+// This function returns whether a cell of the cave is a wall before it's smoothed.
+// The cells out of the map are floors, so the cave stays open along the edges.
+bool getCaveWall(const Generator *generator, const int x, const int y)
+{
+    if (x < 0 || x >= generator->width || y < 0 || y >= generator->height)
+    {
+        return false;
+    }
+
+    return hashRandom(generator->seed, y, x) % 100 < CAVE_FILL;
+}
+
+// This function fills the row "y" of the random fill into "caveRows".
+void fillCaveRow(Generator *generator, const int y)
+{
+    unsigned char *row = generator->caveRows + (size_t)(((y % 3) + 3) % 3) * generator->width;
+
+    for (int x = 0; x < generator->width; ++x)
+    {
+        row[x] = getCaveWall(generator, x, y);
+    }
+}
+
+// This function returns whether a cell of the rooms map is a wall.
+// Each wall between two rooms has one door.
+bool getRoomWall(const Generator *generator, const int x, const int y)
+{
+    const int cellX = x % (ROOM_SIZE + 1);
+    const int cellY = y % (ROOM_SIZE + 1);
+    const int roomX = x / (ROOM_SIZE + 1);
+    const int roomY = y / (ROOM_SIZE + 1);
+
+    if (cellX == ROOM_SIZE && cellY == ROOM_SIZE)
+    {
+        return true;
+    }
+    else if (cellX == ROOM_SIZE)
+    {
+        // the door is somewhere on the side of the room, which can be cut by the map.
+        const int64_t side = generator->height - (int64_t)roomY * (ROOM_SIZE + 1);
+        const int span = (side < ROOM_SIZE) ? (int)side : ROOM_SIZE;
+        return cellY != (int)(hashRandom(generator->seed, roomY, (uint64_t)roomX * 2) % span);
+    }
+    else if (cellY == ROOM_SIZE)
+    {
+        const int64_t side = generator->width - (int64_t)roomX * (ROOM_SIZE + 1);
+        const int span = (side < ROOM_SIZE) ? (int)side : ROOM_SIZE;
+        return cellX != (int)(hashRandom(generator->seed, roomY, (uint64_t)roomX * 2 + 1) % span);
+    }
+
+    return false;
+}
+
+// This function checks whether (x, y) is the exit of the map.
+// The start is always (0, 0), and the exit is as far from it as the map allows.
+bool isExitCell(const Generator *generator, const int x, const int y)
+{
+    const int lastX = generator->width - 1;
+    const int lastY = generator->height - 1;
+
+    switch (generator->type)
+    {
+        case MAP_MAZE:
+            // the last room of the maze.
+            return x == lastX - lastX % 2 && y == lastY - lastY % 2;
+
+        case MAP_ROOMS:
+            // the corner of the last room, which is never a wall.
+            return x == lastX - (lastX % (ROOM_SIZE + 1) == ROOM_SIZE) &&
+                   y == lastY - (lastY % (ROOM_SIZE + 1) == ROOM_SIZE);
+
+        case MAP_SERPENTINE:
+            // the end of the last corridor.
+            return y == lastY - lastY % 2 && x == (((y / 2) % 2 == 0) ? lastX : 0);
+
+        default:
+            return x == lastX && y == lastY;
+    }
+}
+
+// This function fills the row "y" of the map, without the newline.
+void fillRow(Generator *generator, const int y, char *row)
+{
+    const int width = generator->width;
+
+    if (generator->type == MAP_CAVE)
+    {
+        // a cell is a wall if most of the cells around it are walls.
+        if (y == 0)
+        {
+            fillCaveRow(generator, -1);
+            fillCaveRow(generator, 0);
+        }
+        fillCaveRow(generator, y + 1);
+    }
+
+    for (int x = 0; x < width; ++x)
+    {
+        bool wall = false;
+
+        switch (generator->type)
+        {
+            case MAP_MAZE:
+                wall = !isMazeOpen(generator, (int64_t)y * width + x);
+                break;
+
+            case MAP_CAVE:
+            {
+                int walls = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    const unsigned char *caveRow = generator->caveRows + (size_t)(((y + dy) % 3 + 3) % 3) * width;
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        walls += (x + dx < 0 || x + dx >= width) ? 0 : caveRow[x + dx];
+                    }
+                }
+                wall = walls >= 5;
+                break;
+            }
+
+            case MAP_ROOMS:
+                wall = getRoomWall(generator, x, y);
+                break;
+
+            case MAP_SERPENTINE:
+                // the odd rows are walls with a gap at one end, on alternate sides.
+                wall = y % 2 == 1 && x != (((y / 2) % 2 == 0) ? width - 1 : 0);
+                break;
+        }
+
+        row[x] = wall ? '#' : '.';
+        if (isExitCell(generator, x, y))
+        {
+            row[x] = 'x';
+        }
+    }
+
+    // the start is always open.
+    if (y == 0 && row[0] == '#')
+    {
+        row[0] = '.';
+    }
+}
+
+// This function writes the size line and all the rows of the map.
+// It returns false when error occurs.
+bool writeMap(Generator *generator, FILE *fPtr)
+{
+    char *row = malloc(sizeof(char) * ((size_t)generator->width + 1));
+    if (row == NULL)
+    {
+        free(generator->open);
+        free(generator->caveRows);
+        errorHandle(3);
+    }
+
+    bool written = fprintf(fPtr, "%d %d\n", generator->width, generator->height) > 0;
+    row[generator->width] = '\n';
+
+    for (int y = 0; y < generator->height && written; ++y)
+    {
+        fillRow(generator, y, row);
+        written = fwrite(row, sizeof(char), (size_t)generator->width + 1, fPtr) == (size_t)generator->width + 1;
+    }
+
+    free(row);
+    return written;
+}
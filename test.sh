@@ -0,0 +1,194 @@
+#!/bin/sh
+# 6518738 zy18738 Hangjian Yuan
+#
+# Generates maps from a fixed seed with mazegen.c and checks the paths printed by each solver of dungeon.c.
+# A path must start at the start, move one cell at a time through cells which aren't walls, and end on an exit.
+# The exact solvers must print a path as long as "bfs", "hpa" only has to print a valid path at least as long.
+#
+# On an open map "dobfs" must switch to its bottom-up sweeps, which is checked with the counters of "--stats".
+#
+# The larger size classes check the limits of the cell IDs on maps of walls with one open row:
+# "int32" has maps around 2^29 and 2^31 cells, and "uint32" adds a map of more than 2^32 cells.
+# They need about 2 GB and 4.3 GB of disk for the largest map, and a few GB of memory.
+#
+# Usage: ./test.sh [seed] [small|int32|uint32]
+
+set -e
+
+SEED=${1:-1}
+SIZE_CLASS=${2:-small}
+EXACT="bidirectional astar jps parallel dobfs"
+TYPES="maze cave rooms serpentine"
+STARTS=20
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/dungeon-test.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+
+cc -O2 -pthread -o "$WORK/dungeon" dungeon.c
+cc -O2 -pthread -DDUNGEON_STATS -o "$WORK/dungeon-stats" dungeon.c
+cc -O2 -o "$WORK/mazegen" mazegen.c
+
+failures=0
+
+# prints the length of the path in "$4" from ("$2", "$3") on the map "$1", or "none" if there is no escape.
+# It fails if the path isn't valid.
+checkPath() {
+    awk -v startX="$2" -v startY="$3" '
+        FNR == NR {
+            if (FNR == 1) { width = $1; height = $2 }
+            else if ($0 !~ /^:/) { rows[count++] = $0 }
+            next
+        }
+        $0 == "No escape possible." { none = (steps == 1); next }
+        {
+            split($0, point, ",")
+            x = point[1] + 0; y = point[2] + 0
+            if (steps == 0 && (x != startX || y != startY)) { exit 1 }
+            if (steps > 0 && (x - lastX) * (x - lastX) + (y - lastY) * (y - lastY) != 1) { exit 1 }
+            if (x < 0 || y < 0 || x >= width || y >= height || substr(rows[y], x + 1, 1) == "#") { exit 1 }
+            lastX = x; lastY = y; steps++
+        }
+        END {
+            if (none) { print "none" }
+            else if (steps > 0 && substr(rows[lastY], lastX + 1, 1) == "x") { print steps }
+            else { exit 1 }
+        }' "$1" "$4"
+}
+
+# reports a failed check of "$1".
+fail() {
+    echo "FAIL $1"
+    failures=$((failures + 1))
+}
+
+for type in $TYPES; do
+    side=$((40 + SEED % 20))
+    "$WORK/mazegen" "$type" "$side" "$side" "$SEED" "$WORK/$type.map"
+
+    # the starts are spread over the map, the walls are skipped.
+    for start in $(awk -v seed="$SEED" -v side="$side" -v count="$STARTS" \
+            'BEGIN { srand(seed); for (i = 0; i < count; i++) printf "%d,%d\n", int(rand() * side), int(rand() * side) }'); do
+        x=${start%,*}
+        y=${start#*,}
+
+        if ! "$WORK/dungeon" "$WORK/$type.map" "$x" "$y" > "$WORK/bfs.out"; then
+            continue
+        fi
+        if ! expected=$(checkPath "$WORK/$type.map" "$x" "$y" "$WORK/bfs.out"); then
+            fail "$type bfs $x $y"
+            continue
+        fi
+
+        for solver in $EXACT; do
+            if ! "$WORK/dungeon" --algo="$solver" "$WORK/$type.map" "$x" "$y" > "$WORK/$solver.out" ||
+               [ "$(checkPath "$WORK/$type.map" "$x" "$y" "$WORK/$solver.out")" != "$expected" ]; then
+                fail "$type $solver $x $y"
+            fi
+        done
+
+        # HPA* paths are near-optimal, so only their validity is checked.
+        if ! "$WORK/dungeon" --algo=hpa "$WORK/$type.map" "$x" "$y" > "$WORK/hpa.out" ||
+           ! hpaLength=$(checkPath "$WORK/$type.map" "$x" "$y" "$WORK/hpa.out"); then
+            fail "$type hpa $x $y"
+        elif [ "$expected" = "none" ] || [ "$hpaLength" = "none" ]; then
+            [ "$hpaLength" = "$expected" ] || fail "$type hpa $x $y"
+        elif [ "$hpaLength" -lt "$expected" ]; then
+            fail "$type hpa $x $y"
+        fi
+    done
+
+    rm -f "$WORK/$type.map"
+done
+
+# writes an open map of "$1" x "$2" to "$3", whose only exit is the bottom right corner.
+writeOpenMap() {
+    {
+        echo "$1 $2"
+        row=$(head -c "$1" < /dev/zero | tr '\0' '.')
+        yes "$row" | head -n $(($2 - 1))
+        head -c $(($1 - 1)) < /dev/zero | tr '\0' '.'
+        echo x
+    } > "$3"
+}
+
+# the frontier of the last levels is large next to the cells left, so "dobfs" sweeps them bottom-up.
+side=$((200 + SEED % 100))
+writeOpenMap "$side" "$side" "$WORK/open.map"
+if ! "$WORK/dungeon-stats" --algo=dobfs --stats "$WORK/open.map" 0 0 > "$WORK/open.out" 2> "$WORK/open.stats" ||
+   [ "$(checkPath "$WORK/open.map" 0 0 "$WORK/open.out")" != "$((side * 2 - 1))" ]; then
+    fail "open dobfs"
+elif [ "$(awk '$1 == "bottom_up_levels" { print $2 }' "$WORK/open.stats")" -eq 0 ]; then
+    fail "open dobfs never swept bottom-up"
+fi
+rm -f "$WORK/open.map"
+
+# writes a map of walls to "$3", whose last row is open with an exit 10 cells from the right.
+writeSparseMap() {
+    {
+        echo "$1 $2"
+        row=$(head -c "$1" < /dev/zero | tr '\0' '#')
+        yes "$row" | head -n $(($2 - 1))
+        head -c $(($1 - 10)) < /dev/zero | tr '\0' '.'
+        printf 'x'
+        head -c 9 < /dev/zero | tr '\0' '.'
+        echo
+    } > "$3"
+}
+
+# checks that "$@" goes left from the bottom right corner of the map "$WORK/sparse.map" of "$width" x "$height".
+checkSparse() {
+    awk -v x="$((width - 1))" -v y="$((height - 1))" \
+        'BEGIN { for (i = 0; i < 10; i++) printf "%d,%d\n", x - i, y }' > "$WORK/expected.out"
+
+    if ! "$WORK/dungeon" "$@" "$WORK/sparse.map" "$((width - 1))" "$((height - 1))" > "$WORK/sparse.out" ||
+       ! cmp -s "$WORK/expected.out" "$WORK/sparse.out"; then
+        fail "${width}x$height $*"
+    fi
+}
+
+# checks that "$@" refuses the map "$WORK/sparse.map", because its cells don't fit in the IDs of the mode.
+checkTooLarge() {
+    status=0
+    "$WORK/dungeon" "$@" "$WORK/sparse.map" "$((width - 1))" "$((height - 1))" > /dev/null < /dev/null || status=$?
+    [ "$status" -eq 9 ] || fail "${width}x$height $* exited with $status"
+}
+
+if [ "$SIZE_CLASS" = "int32" ] || [ "$SIZE_CLASS" = "uint32" ]; then
+    # JPS needs 4 IDs for each cell, 23170^2 fits and 23171^2 doesn't.
+    width=23170; height=23170
+    writeSparseMap "$width" "$height" "$WORK/sparse.map"
+    checkSparse --algo=jps
+    checkSparse --layout=blocked
+
+    width=23171; height=23171
+    writeSparseMap "$width" "$height" "$WORK/sparse.map"
+    checkTooLarge --algo=jps
+    checkSparse --algo=astar
+    checkSparse
+
+    # the cells fit in 31 bits, but the blocked grid with its border doesn't.
+    width=46340; height=46340
+    writeSparseMap "$width" "$height" "$WORK/sparse.map"
+    checkTooLarge --layout=blocked
+    checkSparse
+
+    # more than 2^31 cells, only the BFS over the rows works, with 32-bit IDs.
+    width=46341; height=46341
+    writeSparseMap "$width" "$height" "$WORK/sparse.map"
+    checkSparse
+    checkTooLarge --algo=astar
+    checkTooLarge --dynamic
+    checkTooLarge --components
+fi
+
+if [ "$SIZE_CLASS" = "uint32" ]; then
+    # more than 2^32 cells, the BFS uses 64-bit IDs.
+    width=65536; height=65536
+    writeSparseMap "$width" "$height" "$WORK/sparse.map"
+    checkSparse
+    checkTooLarge --algo=dobfs
+fi
+
+rm -f "$WORK/sparse.map"
+echo "$failures failures"
+[ "$failures" -eq 0 ]